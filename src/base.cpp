@@ -77,19 +77,16 @@ bool file_get_pixels( const std::string& filepath,
 		return false;
 	}
 	
-    outBuffer.resize( outWidth * outHeight * outBpp, 255 );
+    const size_t rowBytes = size_t( outWidth ) * size_t( outBpp );
 
-	// Flip image....
+    outBuffer.resize( rowBytes * size_t( outHeight ) );
+
+	// Flip image, a row at a time....
 	for ( int32_t y = 0; y < outHeight; ++y )
 	{
-		for ( int32_t x = 0; x < outWidth; ++x )
-		{
-			memcpy( &outBuffer[ outBpp * ( y * outWidth + x ) ],
-				&imagePixels[ outBpp * ( ( outHeight - 1 - y ) * outWidth + x ) ],
-					outBpp * sizeof( uint8_t )) ;
-		}
+		memcpy( &outBuffer[ rowBytes * size_t( y ) ],
+			&imagePixels[ rowBytes * size_t( outHeight - 1 - y ) ], rowBytes );
 	}
-		//memcpy( &outBuffer[ 0 ], imagePixels, outBuffer.size() );
 
 	stbi_image_free( imagePixels );
 
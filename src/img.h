@@ -1,23 +1,42 @@
 #pragma once
 
 #include "def.h"
+#include "img/memory.h"
+#include "img/netpbm.h"
+#include "img/raw_file.h"
+#include "img/resample.h"
+#include "img/simd.h"
+#include "img/srgb.h"
+#include "img/thread_pool.h"
+#include "img/tile_cache.h"
 
 #include <vector>
 #include <stdlib.h>
+#include <stdio.h>
 #include <stdint.h>
 #include <sstream>
 #include <string>
 #include <cstring>
 #include <array>
+#include <limits>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <complex>
 #include <lib/stb_image.h>
 #include <glm/glm.hpp>
 #include <lib/glm/mat3x3.hpp>
 #include <lib/glm/gtc/matrix_access.hpp>
+#include <lib/glm/gtc/packing.hpp>
 
 // These are nice in situations when you find yourself making lots of changes as you go along :)
 // Given time, I would replace the macros with their substitutions, but for now they work.
 #define IMG_DEF template <typename Tchannel, color_format Eformat, typename Tint = int32_t>
 #define IMG_DATA_TMPL data<Tchannel, Eformat, Tint>
+#define IMG_PLANAR_TMPL data<Tchannel, Eformat, Tint, layout::planar>
+#define IMG_LAYOUT_DEF template <typename Tchannel, color_format Eformat, typename Tint, layout Elayout>
+#define IMG_LAYOUT_TMPL data<Tchannel, Eformat, Tint, Elayout>
+#define IMG_VIEW_TMPL view<Tchannel, Eformat, Tint>
 #define IMG_INT_TYPE Tint
 #define IMG_PIXEL_TMPL pixel<Tchannel, Eformat, Tint>
 
@@ -71,12 +90,301 @@ static inline glm::tmat3x3<float> kernel_emboss(bool normalize)
 #undef EMBOSS_SAMPLE_FACTOR
 #undef EMBOSS_CENTER_FACTOR
 
+// An N x N kernel, N being odd. Weights are stored row by row, so
+// mWeights[row * N + column]. The 3x3 glm::mat3 kernels above map onto
+// kernel<3> through to_kernel.
+template <size_t N>
+struct kernel
+{
+	static_assert(N % 2 == 1, "kernel sizes need to be odd");
+
+	static const size_t SIZE = N;
+	static const size_t RADIUS = N / 2;
+
+	std::array<float, N * N> mWeights;
+
+	kernel(float v = 0.0f)
+	{
+		mWeights.fill(v);
+	}
+
+	float& operator()(size_t row, size_t column) { return mWeights[row * N + column]; }
+
+	float operator()(size_t row, size_t column) const { return mWeights[row * N + column]; }
+};
+
+// The rows of a mat3 kernel are its column vectors (see make_kernel).
+static inline kernel<3> to_kernel(const glm::mat3& m)
+{
+	kernel<3> k;
+	for (size_t row = 0; row < 3; ++row)
+		for (size_t column = 0; column < 3; ++column)
+			k(row, column) = m[row][column];
+	return k;
+}
+
+// Same normalization as the mat3 version.
+template <size_t N>
+static inline kernel<N> normalize_kernel(const kernel<N>& base)
+{
+	kernel<N> k(base);
+
+	float sum = 0.0f;
+	for (float w: k.mWeights)
+		sum += w * w;
+
+	if (sum != 0.0f) {
+		float len = glm::sqrt(sum);
+		for (float& w: k.mWeights)
+			w /= len;
+	}
+
+	return k;
+}
+
+// Rotates a kernel by 180 degrees; convolving with a kernel is the same
+// as correlating with its flipped counterpart.
+template <size_t N>
+static inline kernel<N> flip_kernel(const kernel<N>& base)
+{
+	kernel<N> k;
+	for (size_t i = 0; i < N * N; ++i)
+		k.mWeights[i] = base.mWeights[N * N - 1 - i];
+	return k;
+}
+
+template <size_t N>
+static inline kernel<N> kernel_box(void)
+{
+	return kernel<N>(1.0f / float(N * N));
+}
+
+// Sampled Gaussian, scaled so that the weights sum to one.
+template <size_t N>
+static inline kernel<N> kernel_gaussian(float sigma)
+{
+	kernel<N> k;
+	const float r = float(N / 2);
+	float sum = 0.0f;
+
+	for (size_t row = 0; row < N; ++row) {
+		for (size_t column = 0; column < N; ++column) {
+			float dx = float(column) - r;
+			float dy = float(row) - r;
+			k(row, column) = glm::exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+			sum += k(row, column);
+		}
+	}
+
+	for (float& w: k.mWeights)
+		w /= sum;
+
+	return k;
+}
+
+// A rank-1 kernel, stored as the two vectors whose outer product it is:
+// weight(row, column) = mColumn[row] * mRow[column].
+template <size_t N>
+struct separable_kernel
+{
+	static_assert(N % 2 == 1, "kernel sizes need to be odd");
+
+	std::array<float, N> mRow;
+	std::array<float, N> mColumn;
+};
+
+template <size_t N>
+static inline separable_kernel<N> make_separable_kernel(const std::array<float, N>& row,
+														const std::array<float, N>& column)
+{
+	separable_kernel<N> k;
+	k.mRow = row;
+	k.mColumn = column;
+	return k;
+}
+
+template <size_t N>
+static inline kernel<N> to_kernel(const separable_kernel<N>& sep)
+{
+	kernel<N> k;
+	for (size_t row = 0; row < N; ++row)
+		for (size_t column = 0; column < N; ++column)
+			k(row, column) = sep.mColumn[row] * sep.mRow[column];
+	return k;
+}
+
+template <size_t N>
+static inline separable_kernel<N> flip_kernel(const separable_kernel<N>& base)
+{
+	separable_kernel<N> k;
+	std::reverse_copy(base.mRow.begin(), base.mRow.end(), k.mRow.begin());
+	std::reverse_copy(base.mColumn.begin(), base.mColumn.end(), k.mColumn.begin());
+	return k;
+}
+
+// Tests whether a kernel is rank-1, and if so, splits it into its row and column vectors.
+// The row and column through the largest weight span the kernel; every other weight has
+// to be reproduced by their product to within a small fraction of that largest weight.
+template <size_t N>
+static inline bool separate_kernel(const kernel<N>& k, separable_kernel<N>* out)
+{
+	const float TOLERANCE = 1e-5f;
+
+	size_t pivot = 0;
+	for (size_t i = 1; i < N * N; ++i)
+		if (glm::abs(k.mWeights[i]) > glm::abs(k.mWeights[pivot]))
+			pivot = i;
+
+	float largest = k.mWeights[pivot];
+	if (largest == 0.0f)
+		return false;
+
+	size_t pivotRow = pivot / N;
+	size_t pivotColumn = pivot % N;
+
+	separable_kernel<N> sep;
+	for (size_t i = 0; i < N; ++i) {
+		sep.mColumn[i] = k(i, pivotColumn);
+		sep.mRow[i] = k(pivotRow, i) / largest;
+	}
+
+	for (size_t row = 0; row < N; ++row)
+		for (size_t column = 0; column < N; ++column)
+			if (glm::abs(sep.mColumn[row] * sep.mRow[column] - k(row, column)) > TOLERANCE * glm::abs(largest))
+				return false;
+
+	if (out)
+		*out = sep;
+
+	return true;
+}
+
+static inline bool separate_kernel(const glm::mat3& k, separable_kernel<3>* out)
+{
+	return separate_kernel(to_kernel(k), out);
+}
+
+// A kernel quantized for arithmetic::fixed_point: weight = mWeights[i] / 2^mShift.
+template <size_t N>
+struct fixed_kernel
+{
+	std::array<int16_t, N * N> mWeights;
+	int32_t mShift;
+};
+
+// Picks the largest shift (at most 14) for which every weight still fits into an
+// int16_t, and a whole neighbourhood of 255s can't overflow the int32_t accumulator.
+template <size_t N>
+static inline fixed_kernel<N> quantize_kernel(const kernel<N>& k)
+{
+	float largest = 0.0f;
+	float total = 0.0f;
+	for (float w: k.mWeights) {
+		largest = glm::max(largest, glm::abs(w));
+		total += glm::abs(w);
+	}
+
+	int32_t shift = 14;
+	while (shift > 0 && (largest * float(1 << shift) > 32767.0f ||
+						 total * 255.0f * float(1 << shift) > 2147483647.0f))
+		--shift;
+
+	fixed_kernel<N> q;
+	q.mShift = shift;
+	for (size_t i = 0; i < N * N; ++i)
+		q.mWeights[i] = int16_t(glm::round(k.mWeights[i] * float(1 << shift)));
+
+	return q;
+}
+
+// Operations which take one of these run either entirely on the calling thread,
+// or split into horizontal bands which are handed out to thread_pool::shared().
+enum class execution
+{
+	sequential,
+	parallel
+};
+
+// How convolutions treat pixels outside of the image:
+//  - wrap: the image tiles (abc|abc|abc); the original behavior
+//  - clamp: the edge pixel repeats (aaa|abc|ccc)
+//  - mirror: the image is reflected, edge included (cba|abc|cba), like GL_MIRRORED_REPEAT
+//  - constant: a fixed value, given in normalized [0, 1] units
+enum class border_mode
+{
+	wrap,
+	clamp,
+	mirror,
+	constant
+};
+
+struct border
+{
+	border_mode mMode;
+	float mConstant;
+
+	border(border_mode mode = border_mode::wrap, float constant = 0.0f)
+		: mMode(mode),
+		  mConstant(constant)
+	{}
+};
+
+// The arithmetic apply_kernel uses on 8 bit images. floating_point normalizes every
+// channel to [0, 1] and works in floats. fixed_point quantizes the kernel once to
+// int16 weights (see quantize_kernel) and does everything else in integers, which
+// is considerably cheaper; float images ignore it.
+//
+// Expected error against floating_point: every weight is rounded to the nearest
+// multiple of 2^-shift, so a result can move by at most N * N * 255 / 2^(shift + 1)
+// before truncation (0.07 for a 3x3 kernel at the usual shift of 14, 0.2 for 5x5).
+// In practice results are either identical or one below/above the float path; the
+// float path's own rounding accounts for the rest of the differences.
+enum class arithmetic
+{
+	floating_point,
+	fixed_point
+};
+
+// The value of each is its number of channels. rgba's fourth channel is alpha (coverage),
+// so it's never sRGB encoded, and conversions give it 1 when there wasn't one.
 enum class color_format
 {
+	rgba = 4,
 	rgb = 3,
 	greyscale = 1
 };
 
+// Besides uint8_t and float, channels can be uint16_t (like uint8_t, normalized to [0, 1]
+// when it comes to math) or half: an IEEE 754 binary16 float, as in GL_HALF_FLOAT, for
+// float images which don't need all of a float's precision and would rather have half
+// of the memory. Halves only store values; they're converted to and from float (through
+// glm's packHalf1x16 and unpackHalf1x16) to do anything with them.
+struct half
+{
+	uint16_t mBits;
+
+	half(void) = default;
+
+	explicit half(float v)
+		: mBits(glm::packHalf1x16(v))
+	{}
+
+	operator float(void) const
+	{
+		return glm::unpackHalf1x16(mBits);
+	}
+};
+
+// How an image's channels are arranged in memory. interleaved (AoS) keeps every
+// pixel's channels next to each other, which is what files and GL want; planar (SoA)
+// gives each channel a buffer of its own, which suits per-channel processing and
+// leaves nothing for SIMD code to shuffle. to_planar and to_interleaved convert.
+enum class layout
+{
+	interleaved,
+	planar
+};
+
 // Simple pixel type. Image data stores a buffer of this.
 IMG_DEF struct pixel
 {
@@ -92,13 +400,16 @@ IMG_DEF struct pixel
 };
 
 // "data" is basically a catch-all term for an image.
-IMG_DEF struct data
+template <typename Tchannel, color_format Eformat, typename Tint = int32_t, layout Elayout = layout::interleaved>
+struct data
 {
 	using channel_t = Tchannel;
 	using int_t = Tint;
     using pixel_t = pixel<Tchannel, Eformat, Tint>;
-    using buffer_t = std::vector<pixel_t>;
+    using buffer_t = std::vector<pixel_t, memory::aligned_allocator<pixel_t>>;
 
+	static const layout LAYOUT = layout::interleaved;
+	static const size_t NUM_CHANNELS = (size_t)Eformat;
     static const size_t PIXEL_STRIDE = (size_t)Eformat;
 	static const size_t PIXEL_STRIDE_BYTES = PIXEL_STRIDE * sizeof(Tchannel);
 
@@ -107,7 +418,93 @@ IMG_DEF struct data
 	// We use a sane default of int32_t, if unspecified.
     int_t mWidth;
     int_t mHeight;
+
+	// The distance between the starts of two rows, in pixels. Rows are padded so that each
+	// one starts on a 64 byte boundary; make_image and friends take care of it (see detail::allocate).
+	int_t mStride;
     buffer_t mPixels;
+
+	// Whether the rows are stored bottom up: row y lives where row mHeight - 1 - y would
+	// otherwise be. Everything which gets at rows goes through calc_pixel_offset, or a
+	// view (which then has a negative stride), so this is invisible to anything but the
+	// memory layout; it's how from_file hands out an image in GL's orientation without
+	// moving any rows around. See flip_vertical.
+	bool mFlipped = false;
+};
+
+// The planar flavour of data: one buffer per channel, each of them
+// mStride * mHeight long. Pixels can still be read and written one at a time through
+// get_pixel and set_pixel, but they only exist as values.
+template <typename Tchannel, color_format Eformat, typename Tint>
+struct data<Tchannel, Eformat, Tint, layout::planar>
+{
+	using channel_t = Tchannel;
+	using int_t = Tint;
+	using pixel_t = pixel<Tchannel, Eformat, Tint>;
+	using plane_t = std::vector<Tchannel, memory::aligned_allocator<Tchannel>>;
+
+	static const layout LAYOUT = layout::planar;
+	static const size_t NUM_CHANNELS = (size_t)Eformat;
+	static const size_t PIXEL_STRIDE = 1; // within a plane
+	static const size_t PIXEL_STRIDE_BYTES = sizeof(Tchannel);
+
+	int_t mWidth;
+	int_t mHeight;
+	int_t mStride; // in channels, the same for every plane
+	std::array<plane_t, NUM_CHANNELS> mPlanes;
+	bool mFlipped = false; // as for interleaved data, and for every plane
+};
+
+// A window onto interleaved pixels which live somewhere else: all of an image, a rectangle
+// of one (see make_view), or any buffer laid out the same way. Views never own what they
+// point at, so whatever that is has to outlive them; copying one copies nothing else.
+// A view of const channels (view<const uint8_t, ...>) is read only, and a mutable view
+// converts to one. Anything which takes a view treats it as an image in its own right:
+// its edges are where borders apply, whatever happens to lie beyond them. The stride
+// may be negative, in which case rows run upwards through memory from mPixels; that's
+// how views of flipped images (and flip_vertical of a view) work.
+template <typename Tchannel, color_format Eformat, typename Tint = int32_t>
+struct view
+{
+	using channel_t = typename std::remove_const<Tchannel>::type;
+	using int_t = Tint;
+	using pixel_t = pixel<channel_t, Eformat, Tint>;
+	using pointer_t = typename std::conditional<std::is_const<Tchannel>::value, const pixel_t*, pixel_t*>::type;
+	using reference_t = typename std::conditional<std::is_const<Tchannel>::value, const pixel_t&, pixel_t&>::type;
+
+	static const layout LAYOUT = layout::interleaved;
+	static const size_t NUM_CHANNELS = (size_t)Eformat;
+	static const size_t PIXEL_STRIDE = (size_t)Eformat;
+	static const size_t PIXEL_STRIDE_BYTES = PIXEL_STRIDE * sizeof(channel_t);
+
+	int_t mWidth;
+	int_t mHeight;
+	int_t mStride; // in pixels, and negative for rows which run bottom up
+	pointer_t mPixels; // the first pixel of the first row
+
+	view(void)
+		: mWidth(0),
+		  mHeight(0),
+		  mStride(0),
+		  mPixels(nullptr)
+	{}
+
+	view(pointer_t pixels, int_t width, int_t height, int_t stride)
+		: mWidth(width),
+		  mHeight(height),
+		  mStride(stride),
+		  mPixels(pixels)
+	{}
+
+	// Copies a view, or makes a read only view out of a mutable one
+	view(const view<channel_t, Eformat, Tint>& other)
+		: mWidth(other.mWidth),
+		  mHeight(other.mHeight),
+		  mStride(other.mStride),
+		  mPixels(other.mPixels)
+	{}
+
+	view& operator=(const view& other) = default;
 };
 
 // It's useful to have the ability to convert the image data to pure bytes in some situations (e.g., if we're using
@@ -115,9 +512,12 @@ IMG_DEF struct data
 using raw_buffer = std::vector<uint8_t>;
 
 // Trivial simple helper methods
-IMG_DEF IMG_INT_TYPE calc_pixel_offset(const IMG_DATA_TMPL &image, IMG_INT_TYPE x, IMG_INT_TYPE y)
+IMG_LAYOUT_DEF IMG_INT_TYPE calc_pixel_offset(const IMG_LAYOUT_TMPL &image, IMG_INT_TYPE x, IMG_INT_TYPE y)
 {
-	return (y * image.mWidth + x);
+	if (image.mFlipped)
+		y = image.mHeight - 1 - y;
+
+	return (y * image.mStride + x);
 }
 
 IMG_DEF IMG_PIXEL_TMPL &get_pixel(IMG_DATA_TMPL &image, IMG_INT_TYPE x, IMG_INT_TYPE y)
@@ -130,208 +530,4171 @@ IMG_DEF const IMG_PIXEL_TMPL &get_pixel(const IMG_DATA_TMPL &image, IMG_INT_TYPE
 	return image.mPixels[calc_pixel_offset(image, x, y)];
 }
 
-// Converts each "pixel" type in the image's
-// data buffer to a corresponding byte representation
-// and returns it as a buffer.
-IMG_DEF raw_buffer get_raw_pixels(const IMG_DATA_TMPL &image)
+// Planar pixels are gathered from (and scattered over) the planes, so they're
+// returned by value; set_pixel works for both layouts.
+IMG_DEF IMG_PIXEL_TMPL get_pixel(const IMG_PLANAR_TMPL &image, IMG_INT_TYPE x, IMG_INT_TYPE y)
 {
-    constexpr size_t stride = (size_t)Eformat;
-
-	// It seems that C++ compilers won't optimize out static
-	// conditionals which evauluate to false... there's use
-	// of an emulated static_if further down, whose implementation
-	// can be found in "base.inl" (it was stolen, link is provided)
-	if (std::is_same<Tchannel, float>::value) {
-		uint8_t* pBytes = (uint8_t*)(&image.mPixels[0].mChannels[0]);
-		constexpr size_t byteStride = stride * sizeof(Tchannel);
-		size_t length = byteStride * image.mPixels.size();
-		raw_buffer pixels(length);
-		memcpy(&pixels[0], pBytes, length);
-		return std::move(pixels);
-    } else {
-		raw_buffer pixels(stride * sizeof(Tchannel) * image.mPixels.size(), 0);
-		memcpy(&pixels[0], &image.mPixels[0].mChannels[0], pixels.size());
-        return std::move(pixels);
-    }
+	IMG_PIXEL_TMPL p;
+	IMG_INT_TYPE offset = calc_pixel_offset(image, x, y);
+	for (size_t c = 0; c < p.mChannels.size(); ++c)
+		p.mChannels[c] = image.mPlanes[c][offset];
+	return p;
 }
 
-// Useful for constructing textures out of user-specified data, rather than image files stored on disk.
-// Obviously not much going on here.
-IMG_DEF IMG_DATA_TMPL make_image(IMG_INT_TYPE width, IMG_INT_TYPE height, const IMG_PIXEL_TMPL &fillValue)
+IMG_DEF void set_pixel(IMG_DATA_TMPL &image, IMG_INT_TYPE x, IMG_INT_TYPE y, const IMG_PIXEL_TMPL &p)
 {
-	size_t size = width * height;
-	IMG_DATA_TMPL img;
-	img.mWidth = width;
-	img.mHeight = height;
-	img.mPixels.resize(size, fillValue);
+	image.mPixels[calc_pixel_offset(image, x, y)] = p;
+}
 
-	return std::move(img);
+IMG_DEF void set_pixel(IMG_PLANAR_TMPL &image, IMG_INT_TYPE x, IMG_INT_TYPE y, const IMG_PIXEL_TMPL &p)
+{
+	IMG_INT_TYPE offset = calc_pixel_offset(image, x, y);
+	for (size_t c = 0; c < p.mChannels.size(); ++c)
+		image.mPlanes[c][offset] = p.mChannels[c];
 }
 
-enum class from_file_error
+IMG_DEF IMG_INT_TYPE calc_pixel_offset(const IMG_VIEW_TMPL &image, IMG_INT_TYPE x, IMG_INT_TYPE y)
 {
-	none,
-	invalid_path,
-	incompatible_format // we return this if stbi_load* returns a channel count for the image which doesn't work with the desired format
-};
+	return (y * image.mStride + x);
+}
 
-// The main image creation function. from_file_error is a pointer specifically because
-// the user just may not care; having the option of a nullptr can be nice in some cases.
-template <typename image_t>
-image_t from_file(const std::string &path, from_file_error *error, bool invertImage = true)
+IMG_DEF typename IMG_VIEW_TMPL::reference_t get_pixel(const IMG_VIEW_TMPL &image, IMG_INT_TYPE x, IMG_INT_TYPE y)
 {
-	image_t img;
-	from_file_error e = from_file_error::none;
+	return image.mPixels[calc_pixel_offset(image, x, y)];
+}
 
-	using channel_t = typename image_t::channel_t;
-	using int_t = typename image_t::int_t;
-	using pixel_t = typename image_t::pixel_t;
+IMG_DEF void set_pixel(const IMG_VIEW_TMPL &image, IMG_INT_TYPE x, IMG_INT_TYPE y, const IMG_PIXEL_TMPL &p)
+{
+	image.mPixels[calc_pixel_offset(image, x, y)] = p;
+}
 
-	int32_t numChannels = 0;
-	channel_t *buffer = nullptr;
+// Views of a whole image...
+IMG_DEF IMG_VIEW_TMPL make_view(const IMG_VIEW_TMPL &image)
+{
+	return image;
+}
 
-	// We use the emulated static_if (*) here to avoid
-	// the compiler complaining about conflicting types for the stbi_load* function
-	// in the opposing conditional
+IMG_DEF IMG_VIEW_TMPL make_view(IMG_DATA_TMPL &image)
+{
+	if (image.mFlipped && image.mHeight > 0)
+		return IMG_VIEW_TMPL(&image.mPixels[calc_pixel_offset(image, IMG_INT_TYPE(0), IMG_INT_TYPE(0))],
+							 image.mWidth, image.mHeight, -image.mStride);
 
-	// (*) see base.inl for the implementation and source reference
-	static_if<std::is_same<channel_t, float>::value>([&](auto f) {
-		f(buffer) = (channel_t*) stbi_loadf(path.c_str(), (int32_t*) &img.mWidth, (int32_t*) &img.mHeight, &numChannels, 0);
-	}).else_([&](auto f) {
-		f(buffer) = (channel_t*) stbi_load(path.c_str(), (int32_t*) &img.mWidth, (int32_t*) &img.mHeight, &numChannels, 0);
-	});
+	return IMG_VIEW_TMPL(image.mPixels.data(), image.mWidth, image.mHeight, image.mStride);
+}
 
-	if (!buffer) {
-		e = from_file_error::invalid_path;
-		goto finish; // Haters gonna hate: I believe goto is still effective in some situations :)
-	}
+IMG_DEF view<const Tchannel, Eformat, Tint> make_view(const IMG_DATA_TMPL &image)
+{
+	return make_view(const_cast<IMG_DATA_TMPL&>(image));
+}
 
-	if ((size_t)numChannels != image_t::PIXEL_STRIDE) {
-		e = from_file_error::incompatible_format;
-		goto finish;
+// ...and of the width x height rectangle whose top left corner is at (x, y). The
+// rectangle is clipped to what it's taken from, so it may come out smaller (or empty).
+IMG_DEF IMG_VIEW_TMPL make_view(const IMG_VIEW_TMPL &image, IMG_INT_TYPE x, IMG_INT_TYPE y,
+								IMG_INT_TYPE width, IMG_INT_TYPE height)
+{
+	IMG_INT_TYPE x0 = glm::clamp(x, IMG_INT_TYPE(0), image.mWidth);
+	IMG_INT_TYPE y0 = glm::clamp(y, IMG_INT_TYPE(0), image.mHeight);
+	IMG_INT_TYPE x1 = glm::clamp(x + width, x0, image.mWidth);
+	IMG_INT_TYPE y1 = glm::clamp(y + height, y0, image.mHeight);
+
+	if (x1 == x0 || y1 == y0)
+		return IMG_VIEW_TMPL(image.mPixels, IMG_INT_TYPE(0), IMG_INT_TYPE(0), image.mStride);
+
+	return IMG_VIEW_TMPL(image.mPixels + calc_pixel_offset(image, x0, y0), x1 - x0, y1 - y0, image.mStride);
+}
+
+IMG_DEF IMG_VIEW_TMPL make_view(IMG_DATA_TMPL &image, IMG_INT_TYPE x, IMG_INT_TYPE y,
+								IMG_INT_TYPE width, IMG_INT_TYPE height)
+{
+	return make_view(make_view(image), x, y, width, height);
+}
+
+IMG_DEF view<const Tchannel, Eformat, Tint> make_view(const IMG_DATA_TMPL &image, IMG_INT_TYPE x, IMG_INT_TYPE y,
+													 IMG_INT_TYPE width, IMG_INT_TYPE height)
+{
+	return make_view(make_view(image), x, y, width, height);
+}
+
+// Turns an image upside down without touching its pixels: views swap their first and
+// last rows and negate their stride, images toggle mFlipped.
+IMG_DEF IMG_VIEW_TMPL flip_vertical(const IMG_VIEW_TMPL &image)
+{
+	if (image.mHeight <= 0)
+		return image;
+
+	return IMG_VIEW_TMPL(image.mPixels + calc_pixel_offset(image, IMG_INT_TYPE(0), image.mHeight - 1),
+						 image.mWidth, image.mHeight, -image.mStride);
+}
+
+IMG_LAYOUT_DEF void flip_vertical(IMG_LAYOUT_TMPL &image)
+{
+	image.mFlipped = !image.mFlipped;
+}
+
+namespace detail {
+
+// Splits count interleaved pixels of C channels each into C separate rows, and back.
+// The channel count is a compile time constant, so the inner loop disappears and
+// each plane is written (or read) front to back.
+template <size_t C, typename channel_t>
+static inline void deinterleave_row(const channel_t* src, const std::array<channel_t*, C>& dst, size_t count)
+{
+	for (size_t i = 0; i < count; ++i) {
+		for (size_t c = 0; c < C; ++c)
+			dst[c][i] = src[i * C + c];
 	}
+}
 
-	// Since we have a goto, we wrap the following in a block to avoid
-	// compiler errors about jumping across stack boundries
-	{
-		size_t length = img.mWidth * img.mHeight;
-		img.mPixels.resize(length, typename image_t::pixel_t(255));
-
-		// STBI loads the image with the top left-most pixel being
-		// the beginning; OpenGL's texture coordinate system has an inverse
-		// relationship with the y-axis, where the bottom left is the origin of
-		// the image.
-		if (invertImage) {
-			for (int_t y = 0; y < img.mHeight; ++y) {
-				for (int_t x = 0; x < img.mWidth; ++x) {
-					pixel_t& pix = img.mPixels[calc_pixel_offset(img, x, y)];
-					channel_t* bpix = &buffer[numChannels * ((img.mHeight - 1 - y) * img.mWidth + x)];
-					memcpy(&pix.mChannels[0], bpix, sizeof(bpix[0]) * numChannels);
-				}
-			}
-		} else {
-			memcpy(&img.mPixels[0].mChannels[0], buffer, image_t::PIXEL_STRIDE_BYTES * length);
-		}
+template <size_t C, typename channel_t>
+static inline void interleave_row(const std::array<const channel_t*, C>& src, channel_t* dst, size_t count)
+{
+	for (size_t i = 0; i < count; ++i) {
+		for (size_t c = 0; c < C; ++c)
+			dst[i * C + c] = src[c][i];
 	}
+}
 
-finish:
-	if (buffer)
-		stbi_image_free(buffer);
+template <typename channel_t>
+static inline void deinterleave_row(const channel_t* src, const std::array<channel_t*, 1>& dst, size_t count)
+{
+	memcpy(dst[0], src, count * sizeof(channel_t));
+}
 
-	if (error)
-		*error = e;
+template <typename channel_t>
+static inline void interleave_row(const std::array<const channel_t*, 1>& src, channel_t* dst, size_t count)
+{
+	memcpy(dst, src[0], count * sizeof(channel_t));
+}
 
-	return std::move(img);
+// The first channel of row y.
+IMG_DEF Tchannel* row_data(IMG_DATA_TMPL &image, IMG_INT_TYPE y)
+{
+	static_assert(sizeof(IMG_PIXEL_TMPL) == IMG_DATA_TMPL::PIXEL_STRIDE_BYTES, "pixels need to be tightly packed");
+	return &image.mPixels[calc_pixel_offset(image, IMG_INT_TYPE(0), y)].mChannels[0];
 }
 
-// Applies an arbitrary kernel matrix to an image; the result
-// is a copy of the source image with the matrix applied to it.
-// Regardless of the image data's format, we use floating point computations.
-template <typename image_t>
-image_t apply_kernel(const image_t& src, const glm::mat3& kernel)
+IMG_DEF const Tchannel* row_data(const IMG_DATA_TMPL &image, IMG_INT_TYPE y)
 {
-	image_t copy(src);
+	static_assert(sizeof(IMG_PIXEL_TMPL) == IMG_DATA_TMPL::PIXEL_STRIDE_BYTES, "pixels need to be tightly packed");
+	return &image.mPixels[calc_pixel_offset(image, IMG_INT_TYPE(0), y)].mChannels[0];
+}
 
-	using int_t = typename image_t::int_t;
-	using pixel_t = typename image_t::pixel_t;
-	using channel_t = typename image_t::channel_t;
+IMG_DEF Tchannel* row_data(const IMG_VIEW_TMPL &image, IMG_INT_TYPE y)
+{
+	static_assert(sizeof(typename IMG_VIEW_TMPL::pixel_t) == IMG_VIEW_TMPL::PIXEL_STRIDE_BYTES,
+				  "pixels need to be tightly packed");
+	return &image.mPixels[calc_pixel_offset(image, IMG_INT_TYPE(0), y)].mChannels[0];
+}
 
-	static const bool IS_FLOAT = std::is_same< float, channel_t >::value;
-
-	// Trivial image-kernel convolving function. Information
-	// on kernels was taken from https://en.wikipedia.org/wiki/Kernel_(image_processing)
-	for (int_t y = 0; y < copy.mHeight; ++y) {
-		for (int_t x = 0; x < copy.mWidth; ++x) {
-			std::array< float, image_t::PIXEL_STRIDE > accum;
-			accum.fill( 0.0f );
-
-			for (int32_t i = -1; i <= 1; ++i) {
-				for (int32_t j = -1; j <= 1; ++j) {
-					int_t px = (x + j) % copy.mWidth;
-
-					// There are other methods for dealing with out of bounds pixels; this method
-					// was the simplest given the amount of time available
-					if (px < 0)
-						px = copy.mWidth + px;
-
-					int_t py = (y + i) % copy.mHeight;
-					if (py < 0)
-						py = copy.mHeight + py;
-
-					// We use 1 - j or i because the example given in the Wiki article
-					// follows the same inverse relationship; I'm not sure if other methods
-					// are used.
-					int_t kx = 1 - j;
-					int_t ky = 1 - i;
-
-					const pixel_t& pix = copy.mPixels[calc_pixel_offset(copy, px, py)];
-
-					// If we're not using floats for our image data,
-					// we need to do a bit of conversion.
-					if (IS_FLOAT) {
-						for (uint32_t i = 0; i < accum.size(); ++i)
-							accum[i] += pix.mChannels[i] * kernel[ky][kx];
-					} else {
-						float kernelf = kernel[ky][kx] == 2? -2.0f: kernel[ky][kx];
-						for (uint32_t i = 0; i < accum.size(); ++i) {
-							float x = float(pix.mChannels[i]) / 255.0f;
-							accum[i] += x * kernelf;
-						}
-					}
-				}
-			}
+// Row y of every plane of a planar image.
+IMG_DEF std::array<Tchannel*, (size_t)Eformat> plane_rows(IMG_PLANAR_TMPL &image, IMG_INT_TYPE y)
+{
+	std::array<Tchannel*, (size_t)Eformat> rows;
+	for (size_t c = 0; c < rows.size(); ++c)
+		rows[c] = &image.mPlanes[c][calc_pixel_offset(image, IMG_INT_TYPE(0), y)];
+	return rows;
+}
+
+IMG_DEF std::array<const Tchannel*, (size_t)Eformat> plane_rows(const IMG_PLANAR_TMPL &image, IMG_INT_TYPE y)
+{
+	std::array<const Tchannel*, (size_t)Eformat> rows;
+	for (size_t c = 0; c < rows.size(); ++c)
+		rows[c] = &image.mPlanes[c][calc_pixel_offset(image, IMG_INT_TYPE(0), y)];
+	return rows;
+}
 
-			// Make sure nothing is screwed up.
-			for (uint32_t i = 0; i < accum.size(); ++i)
-				accum[i] = glm::clamp(accum[i], 0.0f, 1.0f);
+// The smallest stride (in elements of elementSize bytes) which fits width elements
+// and keeps every row on a memory::ROW_ALIGNMENT boundary.
+template <typename int_t>
+static inline int_t aligned_stride(int_t width, size_t elementSize)
+{
+	size_t alignment = memory::ROW_ALIGNMENT;
+	while (alignment % elementSize != 0)
+		alignment += memory::ROW_ALIGNMENT;
 
-			uint32_t offset = calc_pixel_offset(copy, x, y);
+	const size_t step = alignment / elementSize;
+	return int_t((size_t(width) + step - 1) / step * step);
+}
 
-			static_if<IS_FLOAT>([&](auto f) {
-				f(copy.mPixels[offset].mChannels) = accum;
-			}).else_([&](auto f){
-				for (uint32_t i = 0; i < accum.size(); ++i)
-					f(copy.mPixels[offset].mChannels[i]) = uint8_t(accum[i] * 255.0f);
-			});
-		}
+// Sizes an image's storage for its dimensions, and sets its stride to match;
+// new pixels, padding included, get fillValue.
+IMG_DEF void allocate(IMG_DATA_TMPL &image, const IMG_PIXEL_TMPL &fillValue)
+{
+	image.mStride = aligned_stride(image.mWidth, sizeof(IMG_PIXEL_TMPL));
+	image.mPixels.resize(size_t(image.mStride) * size_t(image.mHeight), fillValue);
+}
+
+IMG_DEF void allocate(IMG_PLANAR_TMPL &image, const IMG_PIXEL_TMPL &fillValue)
+{
+	image.mStride = aligned_stride(image.mWidth, sizeof(Tchannel));
+	for (size_t c = 0; c < image.mPlanes.size(); ++c)
+		image.mPlanes[c].resize(size_t(image.mStride) * size_t(image.mHeight), fillValue.mChannels[c]);
+}
+
+} // namespace detail
+
+// Converts each "pixel" type in the image's
+// data buffer to a corresponding byte representation
+// and returns it as a buffer. Row padding is left out,
+// so the rows are tightly packed; this is what texture uploads.
+IMG_DEF raw_buffer get_raw_pixels(const IMG_VIEW_TMPL &image)
+{
+	const size_t rowBytes = size_t(image.mWidth) * IMG_VIEW_TMPL::PIXEL_STRIDE_BYTES;
+
+	raw_buffer pixels(rowBytes * size_t(image.mHeight));
+	if (pixels.empty())
+		return pixels;
+
+	if (image.mStride == image.mWidth) {
+		memcpy(&pixels[0], detail::row_data(image, IMG_INT_TYPE(0)), pixels.size());
+	} else {
+		for (IMG_INT_TYPE y = 0; y < image.mHeight; ++y)
+			memcpy(&pixels[size_t(y) * rowBytes], detail::row_data(image, y), rowBytes);
 	}
+	return pixels;
+}
 
-	return std::move(copy);
+IMG_DEF raw_buffer get_raw_pixels(const IMG_DATA_TMPL &image)
+{
+	return get_raw_pixels(make_view(image));
 }
 
-// Debugging...
-IMG_DEF std::string to_string(const IMG_DATA_TMPL &image)
+// Raw pixels always come out interleaved, since that's what everything
+// which consumes them (GL, mostly) expects.
+IMG_DEF raw_buffer get_raw_pixels(const IMG_PLANAR_TMPL &image)
 {
-	std::stringstream stream;
+	constexpr size_t stride = (size_t)Eformat;
+	const size_t rowLength = size_t(image.mWidth) * stride;
+
+	raw_buffer pixels(rowLength * size_t(image.mHeight) * sizeof(Tchannel));
 	for (IMG_INT_TYPE y = 0; y < image.mHeight; ++y) {
-		for (IMG_INT_TYPE x = 0; x < image.mWidth; ++x) {
-			stream << to_string(get_pixel(image, x, y));
-			if ((x + 1) != image.mWidth)
-				stream << ", ";
-		}
-		stream << '\n';
+		Tchannel* dst = (Tchannel*)&pixels[size_t(y) * rowLength * sizeof(Tchannel)];
+		detail::interleave_row<stride>(detail::plane_rows(image, y), dst, size_t(image.mWidth));
 	}
-	return stream.str();
+	return pixels;
+}
+
+// Useful for constructing textures out of user-specified data, rather than image files stored on disk.
+// Obviously not much going on here. The second form takes the image type, which is how planar images are made.
+template <typename image_t>
+image_t make_image(typename image_t::int_t width, typename image_t::int_t height,
+				   const typename image_t::pixel_t &fillValue)
+{
+	image_t img;
+	img.mWidth = width;
+	img.mHeight = height;
+	detail::allocate(img, fillValue);
+
+	return img;
+}
+
+IMG_DEF IMG_DATA_TMPL make_image(IMG_INT_TYPE width, IMG_INT_TYPE height, const IMG_PIXEL_TMPL &fillValue)
+{
+	return make_image<IMG_DATA_TMPL>(width, height, fillValue);
+}
+
+namespace detail {
+
+// The first and one past the last byte a view spans, whichever way its rows run.
+template <typename Tchannel, color_format Eformat, typename Tint>
+static inline std::pair<const uint8_t*, const uint8_t*> byte_range(const IMG_VIEW_TMPL& image)
+{
+	const uint8_t* first = (const uint8_t*)row_data(image, Tint(0));
+	const uint8_t* last = (const uint8_t*)row_data(image, image.mHeight - 1);
+
+	if (last < first)
+		std::swap(first, last);
+
+	return std::make_pair(first, last + size_t(image.mWidth) * IMG_VIEW_TMPL::PIXEL_STRIDE_BYTES);
+}
+
+// Whether two views share any memory.
+template <typename Ta, typename Tb, color_format Eformat, typename Tint>
+static inline bool overlaps(const view<Ta, Eformat, Tint>& a, const view<Tb, Eformat, Tint>& b)
+{
+	if (a.mWidth <= 0 || a.mHeight <= 0 || b.mWidth <= 0 || b.mHeight <= 0)
+		return false;
+
+	const auto ra = byte_range(a);
+	const auto rb = byte_range(b);
+
+	return ra.first < rb.second && rb.first < ra.second;
+}
+
+} // namespace detail
+
+// Copies the pixels of src into dst, which needs to be the same size;
+// returns false (and leaves dst alone) when it isn't. The two may overlap: rows are
+// copied in whichever order reads each source row before it's overwritten, and when
+// their rows run in opposite directions (a view and its flip_vertical, say) there's
+// no such order, so src is copied aside first.
+template <typename Tsrc, typename Tdst, color_format Eformat, typename Tint>
+bool copy_pixels(const view<Tsrc, Eformat, Tint> &src, const view<Tdst, Eformat, Tint> &dst)
+{
+	if (src.mWidth != dst.mWidth || src.mHeight != dst.mHeight)
+		return false;
+
+	const size_t rowBytes = size_t(src.mWidth) * view<Tsrc, Eformat, Tint>::PIXEL_STRIDE_BYTES;
+
+	if (!detail::overlaps(src, dst)) {
+		for (Tint y = 0; y < src.mHeight; ++y)
+			memcpy(detail::row_data(dst, y), detail::row_data(src, y), rowBytes);
+		return true;
+	}
+
+	if ((src.mStride < 0) != (dst.mStride < 0)) {
+		const raw_buffer copy(get_raw_pixels(src));
+		for (Tint y = 0; y < src.mHeight; ++y)
+			memcpy(detail::row_data(dst, y), &copy[size_t(y) * rowBytes], rowBytes);
+		return true;
+	}
+
+	// Going forwards is safe unless dst's rows lie ahead of src's in the direction they run
+	const bool ahead = (const uint8_t*)detail::row_data(dst, Tint(0)) > (const uint8_t*)detail::row_data(src, Tint(0));
+	if (ahead == (src.mStride > 0)) {
+		for (Tint y = src.mHeight; y-- > 0;)
+			memmove(detail::row_data(dst, y), detail::row_data(src, y), rowBytes);
+	} else {
+		for (Tint y = 0; y < src.mHeight; ++y)
+			memmove(detail::row_data(dst, y), detail::row_data(src, y), rowBytes);
+	}
+
+	return true;
+}
+
+// An image of its own with a copy of what a view sees; this is how a crop is kept.
+IMG_DEF data<typename IMG_VIEW_TMPL::channel_t, Eformat, Tint> make_image(const IMG_VIEW_TMPL &image)
+{
+	using image_t = data<typename IMG_VIEW_TMPL::channel_t, Eformat, Tint>;
+
+	image_t img(make_image<image_t>(image.mWidth, image.mHeight, typename image_t::pixel_t()));
+	copy_pixels(image, make_view(img));
+	return img;
+}
+
+namespace detail {
+
+// Fills an image, whose dimensions are already set, from a buffer of tightly
+// packed, interleaved pixels straight out of stbi_load*. Rows are copied in the
+// order they're decoded in, a memcpy each.
+//
+// STBI loads the image with the top left-most pixel being
+// the beginning; OpenGL's texture coordinate system has an inverse
+// relationship with the y-axis, where the bottom left is the origin of
+// the image. invertImage flips it accordingly, by marking the image as
+// stored bottom up (see data::mFlipped) rather than by moving rows around.
+IMG_DEF void copy_from_buffer(IMG_DATA_TMPL &img, const Tchannel *buffer, bool invertImage)
+{
+	const size_t rowLength = size_t(img.mWidth) * IMG_DATA_TMPL::PIXEL_STRIDE;
+	const size_t rowBytes = size_t(img.mWidth) * IMG_DATA_TMPL::PIXEL_STRIDE_BYTES;
+	allocate(img, IMG_PIXEL_TMPL(Tchannel(255)));
+
+	for (IMG_INT_TYPE y = 0; y < img.mHeight; ++y)
+		memcpy(row_data(img, y), buffer + size_t(y) * rowLength, rowBytes);
+
+	img.mFlipped = invertImage;
+}
+
+// Planar images are split up row by row on the way in.
+IMG_DEF void copy_from_buffer(IMG_PLANAR_TMPL &img, const Tchannel *buffer, bool invertImage)
+{
+	const size_t rowLength = size_t(img.mWidth) * (size_t)Eformat;
+	allocate(img, IMG_PIXEL_TMPL(Tchannel(255)));
+
+	for (IMG_INT_TYPE y = 0; y < img.mHeight; ++y)
+		deinterleave_row<(size_t)Eformat>(buffer + size_t(y) * rowLength, plane_rows(img, y), size_t(img.mWidth));
+
+	img.mFlipped = invertImage;
+}
+
+// stbi_load* for each channel type (the last argument just picks one); whatever comes back
+// goes to stbi_image_free.
+static inline uint8_t* load_file(const char* path, int32_t* width, int32_t* height, int32_t* channels, uint8_t*)
+{
+	return stbi_load(path, width, height, channels, 0);
+}
+
+static inline float* load_file(const char* path, int32_t* width, int32_t* height, int32_t* channels, float*)
+{
+	return stbi_loadf(path, width, height, channels, 0);
+}
+
+// Halves are loaded as floats and packed in place, front to back.
+static inline half* load_file(const char* path, int32_t* width, int32_t* height, int32_t* channels, half*)
+{
+	uint8_t* bytes = (uint8_t*) stbi_loadf(path, width, height, channels, 0);
+	if (!bytes)
+		return nullptr;
+
+	const size_t count = size_t(*width) * size_t(*height) * size_t(*channels);
+	for (size_t i = 0; i < count; ++i) {
+		float value;
+		memcpy(&value, bytes + i * sizeof(float), sizeof(float));
+
+		const half packed(value);
+		memcpy(bytes + i * sizeof(half), &packed, sizeof(half));
+	}
+
+	return (half*) bytes;
+}
+
+// Whether path is a PNG or PSD with more than 8 bits per channel, which our stb_image
+// can't decode (it has no stbi_load_16). Goes by the header, since stbi_failure_reason
+// is shared by every thread.
+static inline bool deeper_than_8_bits(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	uint8_t header[26];
+	const bool read = fread(header, 1, sizeof(header), file) == sizeof(header);
+	fclose(file);
+
+	if (!read)
+		return false;
+
+	static const uint8_t PNG[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	if (memcmp(header, PNG, sizeof(PNG)) == 0)
+		return header[24] > 8;
+
+	if (memcmp(header, "8BPS", 4) == 0)
+		return ((header[22] << 8) | header[23]) > 8;
+
+	return false;
+}
+
+} // namespace detail
+
+enum class from_file_error
+{
+	none,
+	invalid_path,
+	incompatible_format, // we return this if stbi_load* returns a channel count for the image which doesn't work with the desired format,
+						 // or if the file has more than 8 bits per channel
+	invalid_file // map_file only: the file isn't one write_raw made (or not all of one)
+};
+
+// The main image creation function. from_file_error is a pointer specifically because
+// the user just may not care; having the option of a nullptr can be nice in some cases.
+// Files are decoded to 8 bit, float or half channels; 16 bit images are made with convert.
+template <typename image_t>
+image_t from_file(const std::string &path, from_file_error *error, bool invertImage = true)
+{
+	image_t img;
+	from_file_error e = from_file_error::none;
+
+	using channel_t = typename image_t::channel_t;
+
+	static_assert(!std::is_same<channel_t, uint16_t>::value,
+				  "stb_image only decodes 8 bits per channel; load 8 bit or float images and convert them");
+
+	int32_t numChannels = 0;
+	channel_t *buffer = detail::load_file(path.c_str(), (int32_t*) &img.mWidth, (int32_t*) &img.mHeight, &numChannels,
+										  (channel_t*) nullptr);
+
+	if (!buffer) {
+		e = detail::deeper_than_8_bits(path.c_str()) ? from_file_error::incompatible_format
+													 : from_file_error::invalid_path;
+		goto finish; // Haters gonna hate: I believe goto is still effective in some situations :)
+	}
+
+	if ((size_t)numChannels != image_t::NUM_CHANNELS) {
+		e = from_file_error::incompatible_format;
+		goto finish;
+	}
+
+	detail::copy_from_buffer(img, buffer, invertImage);
+
+finish:
+	if (buffer)
+		stbi_image_free(buffer);
+
+	if (error)
+		*error = e;
+
+	return img;
+}
+
+// Loads a batch of files with from_file on the shared thread pool. done(i, image, error)
+// gets paths[i]'s image (an rvalue; empty if error isn't none) on whichever worker thread
+// decoded it, so calls come in any order and may run concurrently. At most maxInFlight
+// images (one per thread if it's 0) are alive at once. Returns once every file has been
+// through done. Called from inside a pool task, it runs serially on that thread, since
+// thread_pool::parallel_for runs nested calls inline.
+template <typename image_t, typename done_fn_t>
+void for_each_file(const std::vector<std::string> &paths, done_fn_t done, bool invertImage = true,
+				   size_t maxInFlight = 0)
+{
+	thread_pool& pool = thread_pool::shared();
+
+	size_t lanes = pool.concurrency();
+	if (maxInFlight && maxInFlight < lanes)
+		lanes = maxInFlight;
+
+	std::atomic<size_t> next(0);
+
+	pool.parallel_for(std::min(lanes, paths.size()), [&](size_t) {
+		for (size_t i = next++; i < paths.size(); i = next++) {
+			from_file_error e = from_file_error::none;
+			image_t img(from_file<image_t>(paths[i], &e, invertImage));
+
+			// from_file leaves the dimensions of a file in the wrong format behind
+			if (e != from_file_error::none)
+				img = image_t();
+
+			done(i, std::move(img), e);
+		}
+	});
+}
+
+// One file of a from_files batch.
+template <typename image_t>
+struct file_result
+{
+	image_t mImage;
+	from_file_error mError;
+};
+
+// for_each_file, for when all of the images are wanted at once: result[i] is paths[i].
+template <typename image_t>
+std::vector<file_result<image_t>> from_files(const std::vector<std::string> &paths, bool invertImage = true)
+{
+	std::vector<file_result<image_t>> results(paths.size());
+
+	for_each_file<image_t>(paths, [&](size_t i, image_t&& image, from_file_error e) {
+		results[i].mImage = std::move(image);
+		results[i].mError = e;
+	}, invertImage);
+
+	return results;
+}
+
+namespace detail {
+
+// The raw::channel_type of each channel type (the argument just picks one).
+static inline raw::channel_type raw_channel_type(const uint8_t*) { return raw::channel_type::u8; }
+
+static inline raw::channel_type raw_channel_type(const uint16_t*) { return raw::channel_type::u16; }
+
+static inline raw::channel_type raw_channel_type(const half*) { return raw::channel_type::f16; }
+
+static inline raw::channel_type raw_channel_type(const float*) { return raw::channel_type::f32; }
+
+} // namespace detail
+
+// Saves an image (or a view) in the raw container format (see img/raw_file.h), which
+// map_file loads without decoding anything. Rows are padded out to 64 bytes like an image's
+// own, and written in the order they're stored: a flipped image (or a view with a negative
+// stride) is written bottom up and marked as such, so it comes back flipped. Returns false
+// if path can't be written.
+IMG_DEF bool write_raw(const IMG_VIEW_TMPL &image, const std::string &path)
+{
+	using channel_t = typename IMG_VIEW_TMPL::channel_t;
+
+	const bool flipped = image.mStride < 0;
+	const IMG_INT_TYPE width = glm::max(image.mWidth, IMG_INT_TYPE(0));
+	const IMG_INT_TYPE height = glm::max(image.mHeight, IMG_INT_TYPE(0));
+
+	raw::header h;
+	h.mMagic = raw::MAGIC;
+	h.mVersion = raw::VERSION;
+	h.mWidth = uint32_t(width);
+	h.mHeight = uint32_t(height);
+	h.mChannels = uint32_t(Eformat);
+	h.mChannelType = uint32_t(detail::raw_channel_type((const channel_t*) nullptr));
+	h.mStride = uint64_t(detail::aligned_stride(size_t(width), IMG_VIEW_TMPL::PIXEL_STRIDE_BYTES)) *
+				IMG_VIEW_TMPL::PIXEL_STRIDE_BYTES;
+	h.mFlipped = flipped ? 1 : 0;
+	h.mReserved = 0;
+	h.mDataOffset = raw::DATA_OFFSET;
+
+	return raw::write_file(path.c_str(), h, [&](uint32_t i) -> const void* {
+		return detail::row_data(image, flipped ? height - 1 - IMG_INT_TYPE(i) : IMG_INT_TYPE(i));
+	});
+}
+
+IMG_DEF bool write_raw(const IMG_DATA_TMPL &image, const std::string &path)
+{
+	return write_raw(make_view(image), path);
+}
+
+// What map_file returns: mView points into mFile, so it's good for as long as mFile
+// stays open (moving the whole thing around is fine). make_image(mView) copies it.
+template <typename Tchannel, color_format Eformat, typename Tint = int32_t>
+struct mapped_image
+{
+	view<const Tchannel, Eformat, Tint> mView;
+	raw::mapped_file mFile;
+};
+
+// Loads a file write_raw made by mapping it into memory (see raw::mapped_file): the pixels
+// are used where they lie, so this takes about as long as opening the file, however
+// big the image is, and pages are only read in once their rows are touched. A file of
+// another channel type or format gives incompatible_format, and one which isn't a raw
+// image at all (or is cut short) gives invalid_file; either way, mView is empty and the
+// file is closed again. Flipped images come back as views with a negative stride.
+template <typename image_t>
+mapped_image<typename image_t::channel_t, color_format(image_t::NUM_CHANNELS), typename image_t::int_t>
+map_file(const std::string &path, from_file_error *error)
+{
+	using channel_t = typename image_t::channel_t;
+	using int_t = typename image_t::int_t;
+	using result_t = mapped_image<channel_t, color_format(image_t::NUM_CHANNELS), int_t>;
+	using view_t = decltype(result_t::mView);
+
+	const size_t pixelBytes = image_t::NUM_CHANNELS * sizeof(channel_t);
+	const uint64_t largest = uint64_t(std::numeric_limits<int_t>::max());
+
+	result_t result;
+	from_file_error e = from_file_error::none;
+	raw::header h = raw::header();
+
+	const bool opened = result.mFile.open(path.c_str());
+	if (opened && result.mFile.size() >= sizeof(h))
+		memcpy(&h, result.mFile.data(), sizeof(h));
+
+	if (!opened) {
+		e = from_file_error::invalid_path;
+	} else if (!raw::is_valid(h, result.mFile.size())) {
+		e = from_file_error::invalid_file;
+	} else if (h.mChannels != image_t::NUM_CHANNELS ||
+			   h.mChannelType != uint32_t(detail::raw_channel_type((const channel_t*) nullptr)) ||
+			   h.mStride % pixelBytes != 0 || h.mWidth > largest || h.mHeight > largest ||
+			   h.mStride / pixelBytes > largest) {
+		e = from_file_error::incompatible_format;
+	}
+
+	if (e != from_file_error::none) {
+		result.mFile = raw::mapped_file();
+	} else {
+		const int_t stride = int_t(h.mStride / pixelBytes);
+		const typename view_t::pointer_t first = (typename view_t::pointer_t) (result.mFile.data() + h.mDataOffset);
+
+		result.mView = view_t(first, int_t(h.mWidth), int_t(h.mHeight), stride);
+		if (h.mFlipped)
+			result.mView = flip_vertical(result.mView);
+	}
+
+	if (error)
+		*error = e;
+
+	return result;
+}
+
+// Calls fn(y0, y1) over bands of rows which together cover [0, height). With
+// execution::parallel, bands run concurrently on the shared thread pool; there are a
+// few more of them than threads so that an unlucky band doesn't hold everyone up, but
+// never so many that a band gets shorter than minRows. Operations which need
+// neighbouring rows read them themselves, as halo rows around their band.
+template <typename int_t, typename band_fn_t>
+void for_each_band(int_t height, execution policy, band_fn_t fn, int_t minRows = 16)
+{
+	if (height <= 0)
+		return;
+
+	thread_pool& pool = thread_pool::shared();
+
+	if (policy == execution::sequential || pool.concurrency() == 1 || height < 2 * minRows) {
+		fn(int_t(0), height);
+		return;
+	}
+
+	size_t bands = std::min(pool.concurrency() * 4, size_t(height / minRows));
+
+	pool.parallel_for(bands, [&](size_t band) {
+		int_t y0 = int_t(size_t(height) * band / bands);
+		int_t y1 = int_t(size_t(height) * (band + 1) / bands);
+		fn(y0, y1);
+	});
+}
+
+// Moves an image between the two layouts. Rows are independent, so with
+// execution::parallel they're spread over the shared thread pool.
+IMG_DEF data<typename IMG_VIEW_TMPL::channel_t, Eformat, Tint, layout::planar>
+to_planar(const IMG_VIEW_TMPL &image, execution policy = execution::sequential)
+{
+	using planar_t = data<typename IMG_VIEW_TMPL::channel_t, Eformat, Tint, layout::planar>;
+
+	planar_t planar(make_image<planar_t>(image.mWidth, image.mHeight, typename planar_t::pixel_t()));
+
+	for_each_band(image.mHeight, policy, [&](IMG_INT_TYPE y0, IMG_INT_TYPE y1) {
+		for (IMG_INT_TYPE y = y0; y < y1; ++y) {
+			detail::deinterleave_row<(size_t)Eformat>(detail::row_data(image, y), detail::plane_rows(planar, y),
+													  size_t(image.mWidth));
+		}
+	});
+
+	return planar;
+}
+
+IMG_DEF IMG_PLANAR_TMPL to_planar(const IMG_DATA_TMPL &image, execution policy = execution::sequential)
+{
+	return to_planar(make_view(image), policy);
+}
+
+IMG_DEF IMG_DATA_TMPL to_interleaved(const IMG_PLANAR_TMPL &image, execution policy = execution::sequential)
+{
+	IMG_DATA_TMPL interleaved(make_image<IMG_DATA_TMPL>(image.mWidth, image.mHeight, IMG_PIXEL_TMPL()));
+
+	for_each_band(image.mHeight, policy, [&](IMG_INT_TYPE y0, IMG_INT_TYPE y1) {
+		for (IMG_INT_TYPE y = y0; y < y1; ++y) {
+			detail::interleave_row<(size_t)Eformat>(detail::plane_rows(image, y), detail::row_data(interleaved, y),
+													size_t(image.mWidth));
+		}
+	});
+
+	return interleaved;
+}
+
+namespace detail {
+
+// One channel plane of a planar image, made to look like a greyscale image to the
+// row engines below, which only ever go through row_data to get at pixels. The
+// pointer isn't const so that source and destination planes share a type; sources
+// are only ever read.
+template <typename Tchannel, typename Tint>
+struct plane_ref
+{
+	using channel_t = Tchannel;
+	using int_t = Tint;
+
+	static const size_t PIXEL_STRIDE = 1;
+
+	int_t mWidth;
+	int_t mHeight;
+	int_t mStride;
+	channel_t* mData;
+};
+
+// A flipped image's planes come out like a view of it would: starting at the last row
+// in memory, with a negative stride.
+IMG_DEF plane_ref<Tchannel, Tint> make_plane_ref(const IMG_PLANAR_TMPL &image, size_t channel)
+{
+	const Tint offset = image.mHeight > 0 ? calc_pixel_offset(image, Tint(0), Tint(0)) : Tint(0);
+
+	return plane_ref<Tchannel, Tint> { image.mWidth, image.mHeight, image.mFlipped ? -image.mStride : image.mStride,
+										  const_cast<Tchannel*>(&image.mPlanes[channel][0]) + offset };
+}
+
+template <typename Tchannel, typename Tint>
+static inline Tchannel* row_data(const plane_ref<Tchannel, Tint>& plane, Tint y)
+{
+	return plane.mData + ptrdiff_t(y) * ptrdiff_t(plane.mStride);
+}
+
+// Runs fn(src, dst, y0, y1), a row engine, over bands of rows. Interleaved images
+// and views are handed over as they are; planar ones one plane at a time, within each band so
+// that every plane of a band is done by the same thread.
+template <typename src_t, typename dst_t, typename rows_fn_t>
+static inline void for_each_row_band(const src_t &src, dst_t &dst, execution policy, rows_fn_t fn)
+{
+	using int_t = typename dst_t::int_t;
+
+	for_each_band(dst.mHeight, policy, [&](int_t y0, int_t y1) {
+		fn(src, dst, y0, y1);
+	});
+}
+
+template <typename Tsrc, typename Tdst, color_format Eformat, typename Tint, typename rows_fn_t>
+static inline void for_each_row_band(const data<Tsrc, Eformat, Tint, layout::planar> &src,
+									 data<Tdst, Eformat, Tint, layout::planar> &dst, execution policy, rows_fn_t fn)
+{
+	for_each_band(dst.mHeight, policy, [&](Tint y0, Tint y1) {
+		for (size_t c = 0; c < dst.mPlanes.size(); ++c) {
+			const plane_ref<Tsrc, Tint> srcPlane(make_plane_ref(src, c));
+			plane_ref<Tdst, Tint> dstPlane(make_plane_ref(dst, c));
+			fn(srcPlane, dstPlane, y0, y1);
+		}
+	});
+}
+
+// Wraps an out of range coordinate back into [0, extent).
+template <typename int_t>
+static inline int_t wrap_coord(int_t c, int_t extent)
+{
+	c %= extent;
+	return c < 0 ? c + extent : c;
+}
+
+// Maps a coordinate outside of [0, extent) onto the pixel which the border mode
+// says stands in for it; -1 means "use the constant". Only the padding of each
+// row and the rows above and below the image go through here, so none of this
+// is on the per-pixel path.
+template <typename int_t>
+static inline int_t border_coord(int_t c, int_t extent, border_mode mode)
+{
+	if (c >= 0 && c < extent)
+		return c;
+
+	switch (mode) {
+	case border_mode::clamp:
+		return c < 0 ? int_t(0) : extent - 1;
+	case border_mode::mirror:
+		c = wrap_coord(c, int_t(2 * extent));
+		return c < extent ? c : 2 * extent - 1 - c;
+	case border_mode::constant:
+		return int_t(-1);
+	default:
+		return wrap_coord(c, extent);
+	}
+}
+
+// Converts one row of channels into normalized floats; the layout of
+// the channels themselves doesn't change.
+static inline void load_channels(const float* src, float* dst, size_t count)
+{
+	memcpy(dst, src, count * sizeof(float));
+}
+
+static inline void load_channels(const uint8_t* src, float* dst, size_t count)
+{
+	simd::kernels().mLoadU8(src, dst, count);
+}
+
+static inline void load_channels(const uint16_t* src, float* dst, size_t count)
+{
+	simd::kernels().mLoadU16(src, dst, count);
+}
+
+static inline void load_channels(const half* src, float* dst, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		dst[i] = float(src[i]);
+}
+
+// The fixed point path keeps 8 bit channels as they are, just widened.
+static inline void load_channels(const uint8_t* src, int16_t* dst, size_t count)
+{
+	simd::kernels().mLoadU8ToI16(src, dst, count);
+}
+
+// Rank filters keep them exactly as they are.
+static inline void load_channels(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	memcpy(dst, src, count);
+}
+
+// The value a border_mode::constant pixel has in a padded row.
+static inline float border_value(float constant, float*)
+{
+	return constant;
+}
+
+static inline int16_t border_value(float constant, int16_t*)
+{
+	return int16_t(glm::round(glm::clamp(constant, 0.0f, 1.0f) * 255.0f));
+}
+
+static inline uint8_t border_value(float constant, uint8_t*)
+{
+	return uint8_t(glm::round(glm::clamp(constant, 0.0f, 1.0f) * 255.0f));
+}
+
+// The inverse of load_channels: clamps to [0, 1] and writes the result out
+// in the image's native channel type.
+static inline void store_channels(const float* src, float* dst, size_t count)
+{
+	simd::kernels().mStoreF32(src, dst, count);
+}
+
+static inline void store_channels(const float* src, uint8_t* dst, size_t count)
+{
+	simd::kernels().mStoreU8(src, dst, count);
+}
+
+static inline void store_channels(const float* src, uint16_t* dst, size_t count)
+{
+	simd::kernels().mStoreU16(src, dst, count);
+}
+
+// NaNs end up as 0, as they do in the kernels
+static inline void store_channels(const float* src, half* dst, size_t count)
+{
+	for (size_t i = 0; i < count; ++i) {
+		float x = src[i];
+		x = x > 0.0f ? x : 0.0f;
+		dst[i] = half(x < 1.0f ? x : 1.0f);
+	}
+}
+
+// Converts source row y (which may lie outside of the image) into floats (or int16s,
+// for the fixed point path), padded by radius pixels on both sides according to the border.
+template <typename image_t, typename value_t>
+static inline void load_padded_row(const image_t& src, typename image_t::int_t y,
+								   typename image_t::int_t radius, const border& edges, value_t* dst)
+{
+	using int_t = typename image_t::int_t;
+
+	const size_t stride = image_t::PIXEL_STRIDE;
+	const size_t length = (size_t(src.mWidth) + 2 * radius) * stride;
+	const value_t constant = border_value(edges.mConstant, dst);
+	value_t* interior = dst + radius * stride;
+
+	int_t sy = border_coord(y, src.mHeight, edges.mMode);
+	if (sy < 0) {
+		std::fill(dst, dst + length, constant);
+		return;
+	}
+
+	load_channels(row_data(src, sy), interior, size_t(src.mWidth) * stride);
+
+	for (int_t p = 0; p < radius; ++p) {
+		int_t left = border_coord(p - radius, src.mWidth, edges.mMode);
+		int_t right = border_coord(src.mWidth + p, src.mWidth, edges.mMode);
+
+		value_t* leftDst = dst + p * stride;
+		value_t* rightDst = interior + (src.mWidth + p) * stride;
+
+		if (left < 0)
+			std::fill(leftDst, leftDst + stride, constant);
+		else
+			memcpy(leftDst, interior + left * stride, stride * sizeof(value_t));
+
+		if (right < 0)
+			std::fill(rightDst, rightDst + stride, constant);
+		else
+			memcpy(rightDst, interior + right * stride, stride * sizeof(value_t));
+	}
+}
+
+// Holds the last N source rows as floats (or int16s), each padded by the kernel radius
+// on both sides. A row is converted once and then reused by every output row
+// whose window covers it, so the inner loop never has to deal with edges.
+template <size_t N, typename image_t, typename value_t = float>
+struct row_window
+{
+	using int_t = typename image_t::int_t;
+
+	static const int_t RADIUS = int_t(N / 2);
+
+	const image_t& mSrc;
+	border mEdges;
+	size_t mRowLength; // in values, padding included; rounded up so that every row is aligned
+	memory::aligned_vector<value_t> mRows;
+	std::array<int_t, N> mLoaded; // the (unwrapped) source row held by each slot
+
+	row_window(const image_t& src, const border& edges)
+		: mSrc(src),
+		  mEdges(edges),
+		  mRowLength(aligned_stride((size_t(src.mWidth) + 2 * RADIUS) * image_t::PIXEL_STRIDE, sizeof(value_t))),
+		  mRows(mRowLength * N)
+	{
+		mLoaded.fill(std::numeric_limits<int_t>::min());
+	}
+
+	const value_t* row(int_t y)
+	{
+		size_t slot = size_t(wrap_coord<int_t>(y, int_t(N)));
+		value_t* dst = &mRows[slot * mRowLength];
+
+		if (mLoaded[slot] != y) {
+			load_padded_row(mSrc, y, RADIUS, mEdges, dst);
+			mLoaded[slot] = y;
+		}
+
+		return dst;
+	}
+};
+
+// Convolves rows [y0, y1) of src into dst. The kernel has already been flipped,
+// so this is a plain correlation: every tap is a multiply-add over a whole,
+// contiguous row. The tap loop is unrolled (N is known), and the rows themselves
+// go through the SSE2/AVX2 kernels in img/simd.h.
+template <size_t N, typename image_t, typename dst_t>
+static inline void convolve_rows(const image_t& src, dst_t& dst, const kernel<N>& flipped, const border& edges,
+								 typename image_t::int_t y0, typename image_t::int_t y1)
+{
+	using int_t = typename image_t::int_t;
+
+	const auto muladd = simd::kernels().mMulAdd;
+	const size_t stride = image_t::PIXEL_STRIDE;
+	const size_t count = size_t(src.mWidth) * stride;
+	const int_t radius = int_t(N / 2);
+
+	row_window<N, image_t> window(src, edges);
+	memory::aligned_vector<float> accum(count);
+
+	for (int_t y = y0; y < y1; ++y) {
+		std::fill(accum.begin(), accum.end(), 0.0f);
+
+		for (size_t ky = 0; ky < N; ++ky) {
+			const float* row = window.row(y + int_t(ky) - radius);
+
+			for (size_t kx = 0; kx < N; ++kx) {
+				muladd(&accum[0], row + kx * stride, flipped.mWeights[ky * N + kx], count);
+			}
+		}
+
+		store_channels(&accum[0], row_data(dst, y), count);
+	}
+}
+
+// The separable counterpart of convolve_rows. The window here holds rows which
+// have already been filtered horizontally; each one is produced once, straight
+// from a padded source row, and then consumed by the N output rows whose vertical
+// taps cover it while it's still in cache. Both passes are contiguous
+// multiply-adds over whole rows, so the cost per pixel is 2N rather than N * N.
+template <size_t N, typename image_t, typename dst_t>
+static inline void convolve_rows_separable(const image_t& src, dst_t& dst, const separable_kernel<N>& flipped,
+										   const border& edges, typename image_t::int_t y0, typename image_t::int_t y1)
+{
+	using int_t = typename image_t::int_t;
+
+	const auto muladd = simd::kernels().mMulAdd;
+	const size_t stride = image_t::PIXEL_STRIDE;
+	const size_t count = size_t(src.mWidth) * stride;
+	const int_t radius = int_t(N / 2);
+
+	const size_t filteredLength = aligned_stride(count, sizeof(float));
+
+	memory::aligned_vector<float> padded((size_t(src.mWidth) + 2 * radius) * stride);
+	memory::aligned_vector<float> filtered(filteredLength * N);
+	std::array<int_t, N> loaded;
+	loaded.fill(std::numeric_limits<int_t>::min());
+
+	memory::aligned_vector<float> accum(count);
+
+	for (int_t y = y0; y < y1; ++y) {
+		std::fill(accum.begin(), accum.end(), 0.0f);
+
+		for (size_t ky = 0; ky < N; ++ky) {
+			int_t sy = y + int_t(ky) - radius;
+			size_t slot = size_t(wrap_coord<int_t>(sy, int_t(N)));
+			float* row = &filtered[slot * filteredLength];
+
+			if (loaded[slot] != sy) {
+				load_padded_row(src, sy, radius, edges, &padded[0]);
+				std::fill(row, row + count, 0.0f);
+
+				for (size_t kx = 0; kx < N; ++kx)
+					muladd(row, &padded[kx * stride], flipped.mRow[kx], count);
+
+				loaded[slot] = sy;
+			}
+
+			muladd(&accum[0], row, flipped.mColumn[ky], count);
+		}
+
+		store_channels(&accum[0], row_data(dst, y), count);
+	}
+}
+
+// The fixed point counterpart of convolve_rows, for 8 bit images. Taps are consumed
+// two at a time, which lines up with pmaddwd in the SSE2/AVX2 row kernels.
+template <size_t N, typename image_t, typename dst_t>
+static inline void convolve_rows_fixed(const image_t& src, dst_t& dst, const fixed_kernel<N>& flipped,
+									   const border& edges, typename image_t::int_t y0,
+									   typename image_t::int_t y1, std::true_type)
+{
+	using int_t = typename image_t::int_t;
+
+	const simd::row_kernels& rk = simd::kernels();
+	const size_t stride = image_t::PIXEL_STRIDE;
+	const size_t count = size_t(src.mWidth) * stride;
+	const int_t radius = int_t(N / 2);
+
+	row_window<N, image_t, int16_t> window(src, edges);
+	memory::aligned_vector<int32_t> accum(count);
+
+	for (int_t y = y0; y < y1; ++y) {
+		std::fill(accum.begin(), accum.end(), 0);
+
+		for (size_t ky = 0; ky < N; ++ky) {
+			const int16_t* row = window.row(y + int_t(ky) - radius);
+			const int16_t* w = &flipped.mWeights[ky * N];
+
+			size_t kx = 0;
+			for (; kx + 1 < N; kx += 2)
+				rk.mMulAdd2I16(&accum[0], row + kx * stride, row + (kx + 1) * stride, w[kx], w[kx + 1], count);
+
+			rk.mMulAdd2I16(&accum[0], row + kx * stride, row + kx * stride, w[kx], 0, count);
+		}
+
+		rk.mStoreI32ToU8(&accum[0], flipped.mShift, row_data(dst, y), count);
+	}
+}
+
+// Float images never take the fixed point path.
+template <size_t N, typename image_t, typename dst_t>
+static inline void convolve_rows_fixed(const image_t&, dst_t&, const fixed_kernel<N>&, const border&,
+									   typename image_t::int_t, typename image_t::int_t, std::false_type)
+{
+}
+
+// The whole of apply_kernel, bar allocating dst, which has to be the same size as src.
+template <size_t N, typename image_t, typename dst_t>
+static inline void convolve(const image_t& src, dst_t& dst, const kernel<N>& k, execution policy,
+							const border& edges, arithmetic math);
+
+template <size_t N, typename image_t, typename dst_t>
+static inline void convolve(const image_t& src, dst_t& dst, const separable_kernel<N>& k, execution policy,
+							const border& edges, arithmetic math)
+{
+	using int_t = typename image_t::int_t;
+
+	// The fixed point path is 2D only
+	if (math == arithmetic::fixed_point && std::is_same<typename image_t::channel_t, uint8_t>::value) {
+		convolve(src, dst, to_kernel(k), policy, edges, math);
+		return;
+	}
+
+	const separable_kernel<N> flipped(flip_kernel(k));
+
+	if (dst.mWidth > 0) {
+		for_each_row_band(src, dst, policy, [&](const auto& s, auto& d, int_t y0, int_t y1) {
+			convolve_rows_separable(s, d, flipped, edges, y0, y1);
+		});
+	}
+}
+
+template <size_t N, typename image_t, typename dst_t>
+static inline void convolve(const image_t& src, dst_t& dst, const kernel<N>& k, execution policy,
+							const border& edges, arithmetic math)
+{
+	using int_t = typename image_t::int_t;
+	using is_u8_t = std::is_same<typename image_t::channel_t, uint8_t>;
+
+	const bool fixed = math == arithmetic::fixed_point && is_u8_t::value;
+
+	separable_kernel<N> sep;
+	if (!fixed && separate_kernel(k, &sep)) {
+		convolve(src, dst, sep, policy, edges, math);
+		return;
+	}
+
+	if (dst.mWidth <= 0)
+		return;
+
+	if (fixed) {
+		const fixed_kernel<N> quantized(quantize_kernel(flip_kernel(k)));
+		for_each_row_band(src, dst, policy, [&](const auto& s, auto& d, int_t y0, int_t y1) {
+			convolve_rows_fixed(s, d, quantized, edges, y0, y1, is_u8_t());
+		});
+	} else {
+		const kernel<N> flipped(flip_kernel(k));
+		for_each_row_band(src, dst, policy, [&](const auto& s, auto& d, int_t y0, int_t y1) {
+			convolve_rows(s, d, flipped, edges, y0, y1);
+		});
+	}
+}
+
+// What an operation on image_t returns: views give back an image of their own.
+template <typename image_t>
+struct owner
+{
+	using type = image_t;
+};
+
+template <typename Tchannel, color_format Eformat, typename Tint>
+struct owner<IMG_VIEW_TMPL>
+{
+	using type = data<typename IMG_VIEW_TMPL::channel_t, Eformat, Tint>;
+};
+
+
+// Calls fn(source, target): read only and writable views of src and dst. If writing to dst
+// could change pixels of src which are yet to be read, source is a copy of src instead.
+template <typename image_t, typename Tchannel, color_format Eformat, typename Tint, typename fn_t>
+static inline void with_unaliased(const image_t& src, const IMG_VIEW_TMPL& dst, fn_t fn)
+{
+	view<const Tchannel, Eformat, Tint> source(make_view(src));
+	IMG_VIEW_TMPL target(dst);
+
+	if (overlaps(source, target)) {
+		const data<Tchannel, Eformat, Tint> copy(make_image(source));
+		fn(make_view(copy), target);
+	} else {
+		fn(source, target);
+	}
+}
+
+template <typename kernel_t, typename image_t, typename Tchannel, color_format Eformat, typename Tint>
+static inline bool convolve_into(const image_t& src, const IMG_VIEW_TMPL& dst, const kernel_t& k, execution policy,
+								 const border& edges, arithmetic math)
+{
+	if (src.mWidth != dst.mWidth || src.mHeight != dst.mHeight)
+		return false;
+
+	with_unaliased(src, dst, [&](const auto& source, auto& target) {
+		convolve(source, target, k, policy, edges, math);
+	});
+
+	return true;
+}
+
+} // namespace detail
+
+// Convolves an image with a separable kernel: a horizontal pass followed by a vertical one.
+template <size_t N, typename image_t>
+typename detail::owner<image_t>::type apply_kernel(const image_t& src, const separable_kernel<N>& k,
+												   execution policy = execution::sequential,
+												   const border& edges = border(),
+												   arithmetic math = arithmetic::floating_point)
+{
+	using result_t = typename detail::owner<image_t>::type;
+
+	result_t dst(make_image<result_t>(src.mWidth, src.mHeight, typename result_t::pixel_t()));
+	detail::convolve(src, dst, k, policy, edges, math);
+
+	return dst;
+}
+
+// Convolves an image with an arbitrary, odd sized kernel; the result is a new image.
+// Edges wrap around unless another border is given. Unless fixed point arithmetic is
+// asked for, we use floating point computations regardless of the image data's format:
+// 8 bit channels are normalized to [0, 1] first, and all results are clamped to [0, 1].
+// Rank-1 kernels (box, Gaussian, Sobel...) are detected and take the separable path instead.
+// Both layouts work; planar images are convolved one plane at a time. src can also be a
+// view, which gets an image of its own back.
+template <size_t N, typename image_t>
+typename detail::owner<image_t>::type apply_kernel(const image_t& src, const kernel<N>& k,
+												   execution policy = execution::sequential,
+												   const border& edges = border(),
+												   arithmetic math = arithmetic::floating_point)
+{
+	using result_t = typename detail::owner<image_t>::type;
+
+	result_t dst(make_image<result_t>(src.mWidth, src.mHeight, typename result_t::pixel_t()));
+	detail::convolve(src, dst, k, policy, edges, math);
+
+	return dst;
+}
+
+// The original 3x3 entry point; kept so existing callers don't have to change.
+// Information on kernels was taken from https://en.wikipedia.org/wiki/Kernel_(image_processing)
+template <typename image_t>
+typename detail::owner<image_t>::type apply_kernel(const image_t& src, const glm::mat3& k,
+												   execution policy = execution::sequential,
+												   const border& edges = border(),
+												   arithmetic math = arithmetic::floating_point)
+{
+	return apply_kernel(src, to_kernel(k), policy, edges, math);
+}
+
+// The same again, but the result goes into dst instead of a new image: this is how a region
+// of an image is filtered in place, e.g. apply_kernel(make_view(img, x, y, w, h), make_view(img, x, y, w, h), k).
+// src is an interleaved image or view, and has to be the same size as dst; if it isn't,
+// false is returned and nothing happens. dst may overlap src.
+template <size_t N, typename image_t, typename Tchannel, color_format Eformat, typename Tint>
+bool apply_kernel(const image_t& src, const IMG_VIEW_TMPL& dst, const separable_kernel<N>& k,
+				  execution policy = execution::sequential, const border& edges = border(),
+				  arithmetic math = arithmetic::floating_point)
+{
+	return detail::convolve_into(src, dst, k, policy, edges, math);
+}
+
+template <size_t N, typename image_t, typename Tchannel, color_format Eformat, typename Tint>
+bool apply_kernel(const image_t& src, const IMG_VIEW_TMPL& dst, const kernel<N>& k,
+				  execution policy = execution::sequential, const border& edges = border(),
+				  arithmetic math = arithmetic::floating_point)
+{
+	return detail::convolve_into(src, dst, k, policy, edges, math);
+}
+
+template <typename image_t, typename Tchannel, color_format Eformat, typename Tint>
+bool apply_kernel(const image_t& src, const IMG_VIEW_TMPL& dst, const glm::mat3& k,
+				  execution policy = execution::sequential, const border& edges = border(),
+				  arithmetic math = arithmetic::floating_point)
+{
+	return detail::convolve_into(src, dst, to_kernel(k), policy, edges, math);
+}
+
+namespace detail {
+
+// Young, van Vliet and van Ginkel's recursive approximation of a Gaussian: a third order
+// filter run forwards and then backwards along a line, which costs the same per sample
+// whatever sigma is. Its poles are those of their fit for a sigma of 2, moved to wherever
+// makes the variance of the whole come out at exactly sigma squared. Sigmas below 0.5 are
+// taken as 0.5; 0 (or less) is no blur at all. The ends of a line are clamped, and the
+// backward pass starts from the state it would have reached had the line carried on
+// with its last value forever (Triggs and Sdika's boundary conditions), so that edges come
+// out as if the image really did carry on.
+struct recursive_gaussian
+{
+	double mGain;
+	std::array<double, 3> mFeedback;
+	std::array<std::array<double, 3>, 3> mBoundary;
+	bool mIdentity;
+
+	explicit recursive_gaussian(float sigma)
+		: mGain(1.0),
+		  mFeedback { { 0.0, 0.0, 0.0 } },
+		  mBoundary {},
+		  mIdentity(!(sigma > 0.0f))
+	{
+		if (mIdentity)
+			return;
+
+		using pole_t = std::complex<double>;
+
+		const pole_t base[3] = { pole_t(1.41650, 1.00829), pole_t(1.41650, -1.00829), pole_t(1.86543, 0.0) };
+		const double s = std::max(double(sigma), 0.5);
+
+		// Scaling the poles by q (taking their q-th roots) widens the filter; its variance
+		// grows with q, so it can be bisected for
+		auto scaled = [&](size_t k, double q) {
+			return std::polar(std::pow(std::abs(base[k]), 1.0 / q), std::arg(base[k]) / q);
+		};
+
+		double lo = 0.05;
+		double hi = 2.0 * s + 2.0;
+
+		for (int i = 0; i < 64; ++i) {
+			const double q = 0.5 * (lo + hi);
+
+			double variance = 0.0;
+			for (size_t k = 0; k < 3; ++k) {
+				const pole_t d(scaled(k, q));
+				variance += (2.0 * d / ((d - 1.0) * (d - 1.0))).real();
+			}
+
+			(variance < s * s ? lo : hi) = q;
+		}
+
+		pole_t p[3];
+		for (size_t k = 0; k < 3; ++k)
+			p[k] = 1.0 / scaled(k, 0.5 * (lo + hi));
+
+		const double a1 = (p[0] + p[1] + p[2]).real();
+		const double a2 = -(p[0] * p[1] + p[0] * p[2] + p[1] * p[2]).real();
+		const double a3 = (p[0] * p[1] * p[2]).real();
+
+		mGain = 1.0 - (a1 + a2 + a3);
+		mFeedback = { { a1, a2, a3 } };
+
+		// Past the end of a line, the forward pass sees nothing but the last value, so its
+		// output decays towards that. What the backward pass makes of the decaying part is
+		// the sum of that times its own impulse response, which is worked out here for each
+		// of the last three forward outputs (less the last value), until both have died out
+		const size_t length = size_t(40.0 * s) + 64;
+
+		for (size_t k = 0; k < 3; ++k) {
+			std::array<double, 3> tail {};
+			tail[k] = 1.0;
+
+			auto next = [&](void) {
+				const double d = a1 * tail[0] + a2 * tail[1] + a3 * tail[2];
+				tail = { { d, tail[0], tail[1] } };
+				return d;
+			};
+
+			std::array<double, 3> ahead;
+			ahead[0] = next();
+			ahead[1] = next();
+			ahead[2] = next();
+
+			std::array<double, 3> response {};
+
+			for (size_t j = 0; j < length; ++j) {
+				const double h = (j == 0 ? 1.0 : 0.0) + a1 * response[0] + a2 * response[1] + a3 * response[2];
+				response = { { h, response[0], response[1] } };
+
+				for (size_t i = 0; i < 3; ++i)
+					mBoundary[i][k] += mGain * h * ahead[i];
+
+				ahead = { { ahead[1], ahead[2], next() } };
+			}
+		}
+	}
+
+	// Filters count samples of lanes independent lines at once: sample n of line l is
+	// data[n * step + l], and lines are side by side so that the inner loops run over
+	// them, which vectorizes. The filter's state is kept in doubles (state has room for
+	// 4 * lanes of them): for wide blurs the feedback is so close to 1 that float state
+	// would drift visibly. bias is added to the results on their way out.
+	void apply(float* data, size_t count, size_t step, size_t lanes, double* state, float bias) const
+	{
+		if (mIdentity || count == 0) {
+			for (size_t n = 0; n < count; ++n)
+				for (size_t l = 0; l < lanes; ++l)
+					data[n * step + l] += bias;
+			return;
+		}
+
+		const double b = mGain;
+		const double a1 = mFeedback[0];
+		const double a2 = mFeedback[1];
+		const double a3 = mFeedback[2];
+
+		double* ring[3] = { state, state + lanes, state + 2 * lanes };
+		double* last = state + 3 * lanes;
+
+		// A constant line is its own steady state, so the forward pass starts settled
+		for (size_t l = 0; l < lanes; ++l) {
+			ring[0][l] = ring[1][l] = ring[2][l] = double(data[l]);
+			last[l] = double(data[(count - 1) * step + l]);
+		}
+
+		// Each step overwrites the oldest of the three previous outputs
+		for (size_t n = 0; n < count; ++n) {
+			float* x = data + n * step;
+			double* w = ring[n % 3];
+			const double* w1 = ring[(n + 2) % 3];
+			const double* w2 = ring[(n + 1) % 3];
+
+			for (size_t l = 0; l < lanes; ++l) {
+				w[l] = b * double(x[l]) + a1 * w1[l] + a2 * w2[l] + a3 * w[l];
+				x[l] = float(w[l]);
+			}
+		}
+
+		// The backward pass's outputs just past the end, from the last three forward ones
+		{
+			double* u0 = ring[(count + 2) % 3];
+			double* u1 = ring[(count + 1) % 3];
+			double* u2 = ring[count % 3];
+
+			for (size_t l = 0; l < lanes; ++l) {
+				const double d0 = u0[l] - last[l];
+				const double d1 = u1[l] - last[l];
+				const double d2 = u2[l] - last[l];
+
+				const double v0 = mBoundary[0][0] * d0 + mBoundary[0][1] * d1 + mBoundary[0][2] * d2 + last[l];
+				const double v1 = mBoundary[1][0] * d0 + mBoundary[1][1] * d1 + mBoundary[1][2] * d2 + last[l];
+				const double v2 = mBoundary[2][0] * d0 + mBoundary[2][1] * d1 + mBoundary[2][2] * d2 + last[l];
+
+				ring[2][l] = v0;
+				ring[1][l] = v1;
+				ring[0][l] = v2;
+			}
+		}
+
+		for (size_t j = 0; j < count; ++j) {
+			float* x = data + (count - 1 - j) * step;
+			double* y = ring[j % 3];
+			const double* y1 = ring[(j + 2) % 3];
+			const double* y2 = ring[(j + 1) % 3];
+
+			for (size_t l = 0; l < lanes; ++l) {
+				y[l] = b * double(x[l]) + a1 * y1[l] + a2 * y2[l] + a3 * y[l];
+				x[l] = float(y[l]) + bias;
+			}
+		}
+	}
+};
+
+// What makes store_channels, which truncates, round to nearest instead.
+template <typename channel_t>
+static inline float rounding_bias(const channel_t*)
+{
+	return 0.0f;
+}
+
+static inline float rounding_bias(const uint8_t*)
+{
+	return 0.5f / 255.0f;
+}
+
+static inline float rounding_bias(const uint16_t*)
+{
+	return 0.5f / 65535.0f;
+}
+
+// The whole of a recursive blur, for an interleaved image or a plane. The image is
+// filtered into a float copy of itself: along rows first, a group of rows at a time with
+// their channels interleaved, and then down columns, a band of them at a time, each of
+// which goes to dst as soon as it's done. src is read in full before anything is
+// written, so it may be dst.
+template <typename image_t, typename dst_t>
+static inline void recursive_blur(const image_t& src, dst_t& dst, const recursive_gaussian& g, execution policy)
+{
+	using int_t = typename dst_t::int_t;
+	using channel_t = typename dst_t::channel_t;
+
+	constexpr size_t channels = dst_t::PIXEL_STRIDE;
+	constexpr size_t ROWS = 8;
+
+	if (dst.mWidth <= 0 || dst.mHeight <= 0)
+		return;
+
+	const size_t width = size_t(dst.mWidth);
+	const size_t rowLength = width * channels;
+	memory::aligned_vector<float> rows(rowLength * size_t(dst.mHeight));
+
+	for_each_band(dst.mHeight, policy, [&](int_t y0, int_t y1) {
+		memory::aligned_vector<float> packed(width * ROWS * channels);
+		memory::aligned_vector<double> state(4 * ROWS * channels);
+
+		for (int_t y = y0; y < y1; y += int_t(ROWS)) {
+			const size_t group = std::min(ROWS, size_t(y1 - y));
+			const size_t lanes = group * channels;
+			float* first = &rows[size_t(y) * rowLength];
+
+			for (size_t r = 0; r < group; ++r) {
+				float* row = first + r * rowLength;
+				load_channels(row_data(src, y + int_t(r)), row, rowLength);
+
+				for (size_t x = 0; x < width; ++x)
+					for (size_t c = 0; c < channels; ++c)
+						packed[x * lanes + r * channels + c] = row[x * channels + c];
+			}
+
+			g.apply(&packed[0], width, lanes, lanes, &state[0], 0.0f);
+
+			for (size_t r = 0; r < group; ++r) {
+				float* row = first + r * rowLength;
+				for (size_t x = 0; x < width; ++x)
+					for (size_t c = 0; c < channels; ++c)
+						row[x * channels + c] = packed[x * lanes + r * channels + c];
+			}
+		}
+	});
+
+	const float bias = rounding_bias((const channel_t*) nullptr);
+
+	for_each_band(int_t(rowLength), policy, [&](int_t i0, int_t i1) {
+		const size_t lanes = size_t(i1 - i0);
+		memory::aligned_vector<double> state(4 * lanes);
+
+		g.apply(&rows[size_t(i0)], size_t(dst.mHeight), rowLength, lanes, &state[0], bias);
+
+		for (int_t y = 0; y < dst.mHeight; ++y)
+			store_channels(&rows[size_t(y) * rowLength + size_t(i0)], row_data(dst, y) + i0, lanes);
+	}, int_t(64));
+}
+
+template <typename image_t, typename dst_t>
+static inline void recursive_blur(const image_t& src, dst_t& dst, float sigma, execution policy)
+{
+	recursive_blur(src, dst, recursive_gaussian(sigma), policy);
+}
+
+template <typename Tsrc, typename Tdst, color_format Eformat, typename Tint>
+static inline void recursive_blur(const data<Tsrc, Eformat, Tint, layout::planar>& src,
+								  data<Tdst, Eformat, Tint, layout::planar>& dst, float sigma, execution policy)
+{
+	const recursive_gaussian g(sigma);
+
+	for (size_t c = 0; c < dst.mPlanes.size(); ++c) {
+		const plane_ref<Tsrc, Tint> srcPlane(make_plane_ref(src, c));
+		plane_ref<Tdst, Tint> dstPlane(make_plane_ref(dst, c));
+		recursive_blur(srcPlane, dstPlane, g, policy);
+	}
+}
+
+} // namespace detail
+
+// Blurs an image with a Gaussian of standard deviation sigma (in pixels), in time which
+// doesn't depend on sigma: a recursive filter (see detail::recursive_gaussian) runs along
+// the rows and then down the columns, many columns at a time. Edges are clamped, and
+// 8 and 16 bit results are rounded to nearest. Every format and both layouts work, and
+// views get an image of their own back.
+//
+// It's an approximation of the true Gaussian. Its width is exact, but along each axis the
+// impulse response is off by up to 3.5% of its peak at a sigma of 1, 2% at 2, and about
+// 1% from 5 up. On 8 bit images that keeps it within 2 or 3 steps of a wide enough
+// apply_kernel(kernel_gaussian<N>) from a sigma of 2 up; under that, kernel_gaussian is
+// both more accurate and about as quick. It takes a float copy of the image along the way.
+template <typename image_t>
+typename detail::owner<image_t>::type gaussian_blur(const image_t& src, float sigma,
+													execution policy = execution::sequential)
+{
+	using result_t = typename detail::owner<image_t>::type;
+
+	result_t dst(make_image<result_t>(src.mWidth, src.mHeight, typename result_t::pixel_t()));
+	detail::recursive_blur(src, dst, sigma, policy);
+
+	return dst;
+}
+
+// The same again, into dst, which has to be the same size as src (if it isn't, false is
+// returned and nothing happens). src is an interleaved image or view, and may overlap dst.
+template <typename image_t, typename Tchannel, color_format Eformat, typename Tint>
+bool gaussian_blur(const image_t& src, const IMG_VIEW_TMPL& dst, float sigma,
+				   execution policy = execution::sequential)
+{
+	if (src.mWidth != dst.mWidth || src.mHeight != dst.mHeight)
+		return false;
+
+	IMG_VIEW_TMPL target(dst);
+	detail::recursive_blur(src, target, sigma, policy);
+
+	return true;
+}
+
+namespace detail {
+
+// The comparators of a network which puts the median of count values in the middle:
+// Batcher's odd-even merge sort for the next power of two, less everything which touches
+// a value past count (as if those were all larger than the rest) or doesn't lead to the
+// middle output.
+static inline std::vector<std::pair<uint8_t, uint8_t>> median_network(size_t count)
+{
+	std::vector<std::pair<uint8_t, uint8_t>> sort;
+
+	size_t size = 1;
+	while (size < count)
+		size *= 2;
+
+	for (size_t p = 1; p < size; p *= 2) {
+		for (size_t k = p; k >= 1; k /= 2) {
+			for (size_t j = k % p; j + k < size; j += 2 * k) {
+				for (size_t i = 0; i < std::min(k, size - j - k); ++i) {
+					if ((i + j) / (2 * p) == (i + j + k) / (2 * p) && i + j + k < count)
+						sort.push_back(std::make_pair(uint8_t(i + j), uint8_t(i + j + k)));
+				}
+			}
+		}
+	}
+
+	std::vector<bool> needed(count, false);
+	needed[count / 2] = true;
+
+	std::vector<std::pair<uint8_t, uint8_t>> network;
+	for (auto it = sort.rbegin(); it != sort.rend(); ++it) {
+		if (needed[it->first] || needed[it->second]) {
+			needed[it->first] = needed[it->second] = true;
+			network.push_back(*it);
+		}
+	}
+
+	std::reverse(network.begin(), network.end());
+	return network;
+}
+
+// 3x3 and 5x5 medians, through a sorting network: every comparator is a min and a max
+// over a whole run of channels, one per lane, which vectorizes.
+template <size_t N, typename image_t, typename dst_t>
+static inline void median_network_rows(const image_t& src, dst_t& dst, const border& edges,
+									   typename image_t::int_t y0, typename image_t::int_t y1)
+{
+	using int_t = typename image_t::int_t;
+
+	constexpr size_t LANES = 64;
+	constexpr size_t stride = image_t::PIXEL_STRIDE;
+	static const std::vector<std::pair<uint8_t, uint8_t>> network(median_network(N * N));
+
+	const size_t count = size_t(src.mWidth) * stride;
+	const int_t radius = int_t(N / 2);
+
+	row_window<N, image_t, uint8_t> window(src, edges);
+	std::array<const uint8_t*, N> rows;
+	std::array<std::array<uint8_t, LANES>, N * N> values;
+	std::array<uint8_t, LANES> lo;
+	std::array<uint8_t, LANES> hi;
+
+	for (int_t y = y0; y < y1; ++y) {
+		for (size_t r = 0; r < N; ++r)
+			rows[r] = window.row(y + int_t(r) - radius);
+
+		uint8_t* out = row_data(dst, y);
+
+		for (size_t i = 0; i < count; i += LANES) {
+			const size_t lanes = std::min(LANES, count - i);
+
+			for (size_t r = 0; r < N; ++r)
+				for (size_t c = 0; c < N; ++c)
+					memcpy(&values[r * N + c][0], rows[r] + i + c * stride, lanes);
+
+			// Through temporaries, which the compiler can tell apart from the values
+			for (const auto& comparator: network) {
+				std::array<uint8_t, LANES>& a = values[comparator.first];
+				std::array<uint8_t, LANES>& b = values[comparator.second];
+
+				for (size_t l = 0; l < LANES; ++l) {
+					lo[l] = std::min(a[l], b[l]);
+					hi[l] = std::max(a[l], b[l]);
+				}
+
+				a = lo;
+				b = hi;
+			}
+
+			memcpy(out + i, &values[N * N / 2][0], lanes);
+		}
+	}
+}
+
+// Any other median, after Perreault and Hebert: every column of the image (padded for the
+// border) keeps a histogram of its 2 * radius + 1 pixels around the current row, which
+// moves down a row by dropping one pixel and adding another. The window's histogram
+// moves along the row by adding the column which comes into it and taking away the one
+// which leaves. Histograms are two tiered, 16 coarse bins of 16 fine ones each. Only the
+// coarse ones are kept up to date as the window moves; the median's coarse bin is found
+// from those, and then just that bin's fine counts are brought up to date, from the
+// columns which moved through since it was last needed (or from scratch, if that's
+// quicker). Each pixel costs the same whatever the radius.
+template <typename image_t, typename dst_t>
+static inline void median_histogram_rows(const image_t& src, dst_t& dst, typename image_t::int_t radius,
+										 const border& edges, typename image_t::int_t y0, typename image_t::int_t y1)
+{
+	using int_t = typename image_t::int_t;
+
+	constexpr size_t channels = image_t::PIXEL_STRIDE;
+
+	const int_t width = src.mWidth;
+	const size_t span = size_t(2 * radius + 1);
+	const size_t columns = size_t(width) + 2 * size_t(radius); // padded
+	const uint32_t middle = uint32_t(span * span / 2);
+
+	// Column histograms, for every padded column and channel
+	memory::aligned_vector<uint16_t> coarse(columns * channels * 16, 0);
+	memory::aligned_vector<uint16_t> fine(columns * channels * 256, 0);
+	memory::aligned_vector<uint8_t> leaving(columns * channels);
+	memory::aligned_vector<uint8_t> arriving(columns * channels);
+
+	auto add = [&](const uint8_t* row, int delta) {
+		for (size_t i = 0; i < columns * channels; ++i) {
+			coarse[i * 16 + (row[i] >> 4)] += uint16_t(delta);
+			fine[i * 256 + row[i]] += uint16_t(delta);
+		}
+	};
+
+	for (int_t r = -radius; r <= radius; ++r) {
+		load_padded_row(src, y0 + r, radius, edges, &arriving[0]);
+		add(&arriving[0], 1);
+	}
+
+	// The window's histograms, for one channel at a time
+	std::array<uint32_t, 16> windowCoarse;
+	std::array<uint32_t, 256> windowFine;
+	std::array<int_t, 16> updated; // where each coarse bin's fine counts were last brought up to date
+
+	for (int_t y = y0; y < y1; ++y) {
+		if (y > y0) {
+			load_padded_row(src, y - radius - 1, radius, edges, &leaving[0]);
+			load_padded_row(src, y + radius, radius, edges, &arriving[0]);
+			add(&leaving[0], -1);
+			add(&arriving[0], 1);
+		}
+
+		uint8_t* out = row_data(dst, y);
+
+		for (size_t c = 0; c < channels; ++c) {
+			windowCoarse.fill(0);
+			updated.fill(std::numeric_limits<int_t>::min());
+
+			for (size_t j = 0; j < span; ++j) {
+				const uint16_t* column = &coarse[(j * channels + c) * 16];
+				for (size_t b = 0; b < 16; ++b)
+					windowCoarse[b] += column[b];
+			}
+
+			for (int_t x = 0; x < width; ++x) {
+				if (x > 0) {
+					const uint16_t* in = &coarse[((size_t(x) + span - 1) * channels + c) * 16];
+					const uint16_t* gone = &coarse[((size_t(x) - 1) * channels + c) * 16];
+					for (size_t b = 0; b < 16; ++b)
+						windowCoarse[b] += uint32_t(in[b]) - uint32_t(gone[b]);
+				}
+
+				uint32_t below = 0;
+				size_t bin = 0;
+				while (below + windowCoarse[bin] <= middle)
+					below += windowCoarse[bin++];
+
+				uint32_t* counts = &windowFine[bin * 16];
+
+				if (updated[bin] != std::numeric_limits<int_t>::min() && size_t(x - updated[bin]) <= span) {
+					for (int_t p = updated[bin] + 1; p <= x; ++p) {
+						const uint16_t* in = &fine[((size_t(p) + span - 1) * channels + c) * 256 + bin * 16];
+						const uint16_t* gone = &fine[((size_t(p) - 1) * channels + c) * 256 + bin * 16];
+						for (size_t b = 0; b < 16; ++b)
+							counts[b] += uint32_t(in[b]) - uint32_t(gone[b]);
+					}
+				} else {
+					std::fill(counts, counts + 16, uint32_t(0));
+					for (size_t j = size_t(x); j < size_t(x) + span; ++j) {
+						const uint16_t* column = &fine[(j * channels + c) * 256 + bin * 16];
+						for (size_t b = 0; b < 16; ++b)
+							counts[b] += column[b];
+					}
+				}
+
+				updated[bin] = x;
+
+				size_t value = 0;
+				while (below + counts[value] <= middle)
+					below += counts[value++];
+
+				out[size_t(x) * channels + c] = uint8_t(bin * 16 + value);
+			}
+		}
+	}
+}
+
+template <typename image_t, typename dst_t>
+static inline void median_rows(const image_t& src, dst_t& dst, typename image_t::int_t radius, const border& edges,
+							   typename image_t::int_t y0, typename image_t::int_t y1)
+{
+	if (radius == 1)
+		median_network_rows<3>(src, dst, edges, y0, y1);
+	else if (radius == 2)
+		median_network_rows<5>(src, dst, edges, y0, y1);
+	else
+		median_histogram_rows(src, dst, radius, edges, y0, y1);
+}
+
+} // namespace detail
+
+// Replaces every pixel of an 8 bit image by the median of the (2 * radius + 1)^2 pixels
+// around it, channel by channel; pixels past the edges come from the border, which clamps
+// unless told otherwise. It takes out salt and pepper noise and scanner specks while
+// keeping edges sharp, which a blur wouldn't. Radii of 1 and 2 go through sorting
+// networks; wider ones through per column histograms (see detail::median_histogram_rows),
+// which cost the same per pixel whatever the radius. With execution::parallel, bands of
+// rows are filtered concurrently. Both layouts work, and views get an image of their own back.
+template <typename image_t>
+typename detail::owner<image_t>::type median_filter(const image_t& src, typename image_t::int_t radius,
+													execution policy = execution::sequential,
+													const border& edges = border(border_mode::clamp))
+{
+	using result_t = typename detail::owner<image_t>::type;
+	using int_t = typename image_t::int_t;
+
+	static_assert(std::is_same<typename image_t::channel_t, uint8_t>::value, "median_filter takes 8 bit images");
+
+	result_t dst(make_image<result_t>(src.mWidth, src.mHeight, typename result_t::pixel_t()));
+	radius = std::max(radius, int_t(0));
+
+	detail::for_each_row_band(src, dst, policy, [&](const auto& s, auto& d, int_t y0, int_t y1) {
+		if (radius == 0) {
+			for (int_t y = y0; y < y1; ++y)
+				memcpy(detail::row_data(d, y), detail::row_data(s, y), size_t(s.mWidth) * s.PIXEL_STRIDE);
+		} else {
+			detail::median_rows(s, d, radius, edges, y0, y1);
+		}
+	});
+
+	return dst;
+}
+
+namespace detail {
+
+// The running minimum and maximum (erosion and dilation) which morphology is made of,
+// and their bitwise counterparts for masks. identity is what pixels past the edges are
+// taken to be, so that they never win.
+struct min_op
+{
+	template <typename T>
+	T operator()(T a, T b) const { return std::min(a, b); }
+
+	template <typename T>
+	static T identity(void)
+	{
+		return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity()
+													: std::numeric_limits<T>::max();
+	}
+};
+
+struct max_op
+{
+	template <typename T>
+	T operator()(T a, T b) const { return std::max(a, b); }
+
+	template <typename T>
+	static T identity(void)
+	{
+		return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity()
+													: std::numeric_limits<T>::lowest();
+	}
+};
+
+struct and_op
+{
+	uint64_t operator()(uint64_t a, uint64_t b) const { return a & b; }
+
+	template <typename T>
+	static T identity(void) { return ~T(0); }
+};
+
+struct or_op
+{
+	uint64_t operator()(uint64_t a, uint64_t b) const { return a | b; }
+
+	template <typename T>
+	static T identity(void) { return T(0); }
+};
+
+// Where a window of size samples starts, relative to the sample it's for. Erosion and
+// dilation use windows which are each other's reflection, so that opening and closing
+// really are (for even sizes, where the two differ).
+template <typename op_t>
+static inline size_t window_before(size_t size)
+{
+	return std::is_same<op_t, min_op>::value || std::is_same<op_t, and_op>::value ? size / 2 : (size - 1) / 2;
+}
+
+// van Herk and Gil-Werman's running minimum (or maximum, or any other associative and
+// idempotent op) over windows of size samples, starting before samples back: three ops
+// per sample, whatever the size. The line is cut into blocks of size samples; forward
+// holds the running op from the start of each block, backward the one from its end,
+// and every window spans the end of one block and the start of the next. Like
+// recursive_gaussian::apply, this does lanes independent lines at once (sample n of
+// line l is data[n * step + l]), in place. forward and backward have room for
+// (count + size - 1) * lanes values each.
+template <typename value_t, typename op_t>
+static inline void van_herk(value_t* data, ptrdiff_t step, size_t count, size_t lanes, size_t before, size_t size,
+							value_t* forward, value_t* backward, op_t op)
+{
+	if (size <= 1 || count == 0)
+		return;
+
+	const value_t identity = op_t::template identity<value_t>();
+	const size_t padded = count + size - 1;
+
+	auto sample = [&](size_t p) -> const value_t* {
+		return p >= before && p - before < count ? data + ptrdiff_t(p - before) * step : nullptr;
+	};
+
+	for (size_t p = 0; p < padded; ++p) {
+		value_t* f = forward + p * lanes;
+		const value_t* src = sample(p);
+
+		if (p % size == 0) {
+			for (size_t l = 0; l < lanes; ++l)
+				f[l] = src ? src[l] : identity;
+		} else if (src) {
+			const value_t* prev = f - lanes;
+			for (size_t l = 0; l < lanes; ++l)
+				f[l] = op(prev[l], src[l]);
+		} else {
+			std::copy(f - lanes, f, f);
+		}
+	}
+
+	for (size_t p = padded; p-- > 0;) {
+		value_t* b = backward + p * lanes;
+		const value_t* src = sample(p);
+
+		if (p % size == size - 1 || p == padded - 1) {
+			for (size_t l = 0; l < lanes; ++l)
+				b[l] = src ? src[l] : identity;
+		} else if (src) {
+			const value_t* next = b + lanes;
+			for (size_t l = 0; l < lanes; ++l)
+				b[l] = op(next[l], src[l]);
+		} else {
+			std::copy(b + lanes, b + 2 * lanes, b);
+		}
+	}
+
+	for (size_t n = 0; n < count; ++n) {
+		value_t* out = data + ptrdiff_t(n) * step;
+		const value_t* b = backward + n * lanes;
+		const value_t* f = forward + (n + size - 1) * lanes;
+
+		for (size_t l = 0; l < lanes; ++l)
+			out[l] = op(b[l], f[l]);
+	}
+}
+
+// Windows which reach further than the line is long cover the same samples as ones
+// which stop at its far end, and are cheaper.
+template <typename op_t>
+static inline void clip_window(size_t count, size_t& size, size_t& before)
+{
+	before = window_before<op_t>(size);
+	size_t after = size - 1 - before;
+
+	before = std::min(before, count > 0 ? count - 1 : 0);
+	after = std::min(after, count > 0 ? count - 1 : 0);
+	size = before + after + 1;
+}
+
+// Erodes or dilates an interleaved image (or a plane) into dst, which is the same size:
+// along rows first, a group of them at a time with their channels interleaved, then
+// down columns, a band of them at a time. dst may be src.
+template <typename op_t, typename image_t, typename dst_t>
+static inline void morphology(const image_t& src, dst_t& dst, size_t width, size_t height, execution policy)
+{
+	using int_t = typename dst_t::int_t;
+	using channel_t = typename dst_t::channel_t;
+
+	constexpr size_t channels = dst_t::PIXEL_STRIDE;
+	constexpr size_t ROWS = std::max(size_t(1), 32 / sizeof(channel_t));
+
+	if (dst.mWidth <= 0 || dst.mHeight <= 0)
+		return;
+
+	const size_t columns = size_t(dst.mWidth);
+	const size_t rowLength = columns * channels;
+
+	size_t before;
+	clip_window<op_t>(columns, width, before);
+
+	for_each_band(dst.mHeight, policy, [&](int_t y0, int_t y1) {
+		if (width <= 1) {
+			for (int_t y = y0; y < y1; ++y)
+				memmove(row_data(dst, y), row_data(src, y), rowLength * sizeof(channel_t));
+			return;
+		}
+
+		const size_t lanes = ROWS * channels;
+		memory::aligned_vector<channel_t> packed(columns * lanes);
+		memory::aligned_vector<channel_t> forward((columns + width - 1) * lanes);
+		memory::aligned_vector<channel_t> backward((columns + width - 1) * lanes);
+
+		for (int_t y = y0; y < y1; y += int_t(ROWS)) {
+			const size_t group = std::min(ROWS, size_t(y1 - y));
+			const size_t used = group * channels;
+
+			for (size_t r = 0; r < group; ++r) {
+				const channel_t* row = row_data(src, y + int_t(r));
+				for (size_t x = 0; x < columns; ++x)
+					for (size_t c = 0; c < channels; ++c)
+						packed[x * used + r * channels + c] = row[x * channels + c];
+			}
+
+			van_herk(&packed[0], ptrdiff_t(used), columns, used, before, width, &forward[0], &backward[0], op_t());
+
+			for (size_t r = 0; r < group; ++r) {
+				channel_t* row = row_data(dst, y + int_t(r));
+				for (size_t x = 0; x < columns; ++x)
+					for (size_t c = 0; c < channels; ++c)
+						row[x * channels + c] = packed[x * used + r * channels + c];
+			}
+		}
+	});
+
+	clip_window<op_t>(size_t(dst.mHeight), height, before);
+	if (height <= 1)
+		return;
+
+	// Columns go a strip at a time, narrow enough for the running extremes to stay in cache
+	const size_t STRIP = 512;
+	const ptrdiff_t step = row_data(dst, int_t(1)) - row_data(dst, int_t(0));
+
+	for_each_band(int_t(rowLength), policy, [&](int_t i0, int_t i1) {
+		const size_t length = (size_t(dst.mHeight) + height - 1) * std::min(STRIP, size_t(i1 - i0));
+		memory::aligned_vector<channel_t> forward(length);
+		memory::aligned_vector<channel_t> backward(length);
+
+		for (size_t i = size_t(i0); i < size_t(i1); i += STRIP) {
+			van_herk(row_data(dst, int_t(0)) + i, step, size_t(dst.mHeight), std::min(STRIP, size_t(i1) - i), before,
+					 height, &forward[0], &backward[0], op_t());
+		}
+	}, int_t(64));
+}
+
+template <typename op_t, typename Tsrc, typename Tdst, color_format Eformat, typename Tint>
+static inline void morphology(const data<Tsrc, Eformat, Tint, layout::planar>& src,
+							  data<Tdst, Eformat, Tint, layout::planar>& dst, size_t width, size_t height,
+							  execution policy)
+{
+	for (size_t c = 0; c < dst.mPlanes.size(); ++c) {
+		const plane_ref<Tsrc, Tint> srcPlane(make_plane_ref(src, c));
+		plane_ref<Tdst, Tint> dstPlane(make_plane_ref(dst, c));
+		morphology<op_t>(srcPlane, dstPlane, width, height, policy);
+	}
+}
+
+template <typename op_t, typename image_t>
+static inline typename owner<image_t>::type morphology(const image_t& src, typename image_t::int_t width,
+													   typename image_t::int_t height, execution policy)
+{
+	using result_t = typename owner<image_t>::type;
+	using channel_t = typename image_t::channel_t;
+
+	static_assert(std::is_same<channel_t, uint8_t>::value || std::is_same<channel_t, uint16_t>::value ||
+					  std::is_same<channel_t, float>::value,
+				  "morphology takes 8 bit, 16 bit and float channels");
+
+	result_t dst(make_image<result_t>(src.mWidth, src.mHeight, typename result_t::pixel_t()));
+	morphology<op_t>(src, dst, size_t(std::max(width, typename image_t::int_t(1))),
+					 size_t(std::max(height, typename image_t::int_t(1))), policy);
+
+	return dst;
+}
+
+} // namespace detail
+
+// Grey level morphology with a width x height rectangle: erode takes the minimum of the
+// window around every pixel, dilate the maximum, and opening and closing are one followed
+// by the other (opening takes away bright specks smaller than the rectangle, closing
+// fills in dark ones). Pixels past the edges are left out of the windows. Each pass runs
+// along rows and then down columns with van Herk and Gil-Werman's running extremes
+// (see detail::van_herk), so a pixel costs the same whatever the rectangle's size, and
+// the loops run across several rows (or columns) at once, which vectorizes; with
+// execution::parallel, bands of rows and then of columns are split over the thread pool.
+//
+// A window is centred on its pixel, unless a size is even, in which case it reaches one
+// further back for erode than it does forward, and the other way around for dilate. 8 bit,
+// 16 bit and float images of any format and either layout work, and views get an image of
+// their own back.
+template <typename image_t>
+typename detail::owner<image_t>::type erode(const image_t& src, typename image_t::int_t width,
+											typename image_t::int_t height, execution policy = execution::sequential)
+{
+	return detail::morphology<detail::min_op>(src, width, height, policy);
+}
+
+template <typename image_t>
+typename detail::owner<image_t>::type dilate(const image_t& src, typename image_t::int_t width,
+											 typename image_t::int_t height, execution policy = execution::sequential)
+{
+	return detail::morphology<detail::max_op>(src, width, height, policy);
+}
+
+template <typename image_t>
+typename detail::owner<image_t>::type opening(const image_t& src, typename image_t::int_t width,
+											  typename image_t::int_t height, execution policy = execution::sequential)
+{
+	return dilate(erode(src, width, height, policy), width, height, policy);
+}
+
+template <typename image_t>
+typename detail::owner<image_t>::type closing(const image_t& src, typename image_t::int_t width,
+											  typename image_t::int_t height, execution policy = execution::sequential)
+{
+	return erode(dilate(src, width, height, policy), width, height, policy);
+}
+
+// A mask: one bit per pixel, 64 of them to a word, so that morphology can work on 64
+// pixels at a time. Bit x % 64 of word x / 64 of a row is pixel x; rows are mWords
+// long, and the bits past mWidth are always 0.
+template <typename Tint = int32_t>
+struct bitmask
+{
+	using int_t = Tint;
+
+	int_t mWidth;
+	int_t mHeight;
+	size_t mWords;
+	memory::aligned_vector<uint64_t> mBits;
+};
+
+template <typename Tint = int32_t>
+bitmask<Tint> make_bitmask(Tint width, Tint height, bool value = false)
+{
+	bitmask<Tint> mask;
+	mask.mWidth = std::max(width, Tint(0));
+	mask.mHeight = std::max(height, Tint(0));
+	mask.mWords = (size_t(mask.mWidth) + 63) / 64;
+	mask.mBits.assign(mask.mWords * size_t(mask.mHeight), value ? ~uint64_t(0) : uint64_t(0));
+
+	// Keep the bits past the width clear
+	if (value && mask.mWidth % 64)
+		for (Tint y = 0; y < mask.mHeight; ++y)
+			mask.mBits[(size_t(y) + 1) * mask.mWords - 1] = (uint64_t(1) << (mask.mWidth % 64)) - 1;
+
+	return mask;
+}
+
+template <typename Tint>
+bool get_bit(const bitmask<Tint>& mask, Tint x, Tint y)
+{
+	return (mask.mBits[size_t(y) * mask.mWords + size_t(x) / 64] >> (size_t(x) % 64)) & 1;
+}
+
+template <typename Tint>
+void set_bit(bitmask<Tint>& mask, Tint x, Tint y, bool value)
+{
+	uint64_t& word = mask.mBits[size_t(y) * mask.mWords + size_t(x) / 64];
+	const uint64_t bit = uint64_t(1) << (size_t(x) % 64);
+	word = value ? word | bit : word & ~bit;
+}
+
+// Thresholds a greyscale image (or view): a pixel is set where its normalized value is
+// at least level.
+template <typename image_t>
+bitmask<typename image_t::int_t> to_bitmask(const image_t& src, float level = 0.5f,
+											 execution policy = execution::sequential)
+{
+	using int_t = typename image_t::int_t;
+
+	static_assert(image_t::NUM_CHANNELS == 1, "masks are made from greyscale images");
+
+	bitmask<int_t> mask(make_bitmask<int_t>(src.mWidth, src.mHeight));
+
+	for_each_band(mask.mHeight, policy, [&](int_t y0, int_t y1) {
+		memory::aligned_vector<float> values(size_t(mask.mWidth));
+
+		for (int_t y = y0; y < y1; ++y) {
+			detail::load_channels(detail::row_data(src, y), &values[0], values.size());
+			uint64_t* row = &mask.mBits[size_t(y) * mask.mWords];
+
+			for (size_t x = 0; x < values.size(); ++x)
+				row[x / 64] |= uint64_t(values[x] >= level) << (x % 64);
+		}
+	});
+
+	return mask;
+}
+
+// The other way around: set pixels come out as 1.0 (255, for 8 bits) and the rest as 0.
+template <typename image_t, typename Tint>
+image_t to_image(const bitmask<Tint>& mask)
+{
+	static_assert(image_t::NUM_CHANNELS == 1, "masks turn into greyscale images");
+
+	image_t dst(make_image<image_t>(mask.mWidth, mask.mHeight, typename image_t::pixel_t()));
+	memory::aligned_vector<float> values(size_t(mask.mWidth));
+
+	for (Tint y = 0; y < mask.mHeight; ++y) {
+		const uint64_t* row = &mask.mBits[size_t(y) * mask.mWords];
+		for (size_t x = 0; x < values.size(); ++x)
+			values[x] = float((row[x / 64] >> (x % 64)) & 1);
+
+		detail::store_channels(&values[0], detail::row_data(dst, y), values.size());
+	}
+
+	return dst;
+}
+
+namespace detail {
+
+// dst bit b = src bit b + offset, for every bit of words words; bits which that takes
+// from outside src's words words are fill.
+static inline void shift_bits(const uint64_t* src, size_t srcWords, uint64_t* dst, size_t words, ptrdiff_t offset,
+							  uint64_t fill)
+{
+	const ptrdiff_t q = offset >= 0 ? offset / 64 : -((63 - offset) / 64);
+	const unsigned r = unsigned(offset - q * 64);
+
+	auto word = [&](ptrdiff_t i) {
+		return i >= 0 && i < ptrdiff_t(srcWords) ? src[i] : fill;
+	};
+
+	for (size_t i = 0; i < words; ++i) {
+		const ptrdiff_t j = ptrdiff_t(i) + q;
+		dst[i] = r == 0 ? word(j) : (word(j) >> r) | (word(j + 1) << (64 - r));
+	}
+}
+
+// Erodes (and_op) or dilates (or_op) the rows [y0, y1) of a mask along x, 64 pixels at
+// a time. The row is padded with the op's identity so that every window starts at or after
+// it; runs of 1, 2, 4... pixels are then combined by shifting and and'ing (or or'ing)
+// whole words, and the ones which add up to the window's size make it, so a row costs
+// log2 of that many word ops per word.
+template <typename op_t, typename Tint>
+static inline void bitmask_rows(bitmask<Tint>& mask, size_t size, size_t before, Tint y0, Tint y1)
+{
+	const op_t op;
+	const uint64_t fill = op_t::template identity<uint64_t>();
+	const size_t width = size_t(mask.mWidth);
+	const size_t words = (width + size - 1 + 63) / 64;
+	const size_t tail = width % 64;
+
+	memory::aligned_vector<uint64_t> row(mask.mWords);
+	memory::aligned_vector<uint64_t> runs(words);
+	memory::aligned_vector<uint64_t> result(words);
+	memory::aligned_vector<uint64_t> shifted(words);
+
+	for (Tint y = y0; y < y1; ++y) {
+		uint64_t* bits = &mask.mBits[size_t(y) * mask.mWords];
+
+		std::copy(bits, bits + mask.mWords, row.begin());
+		if (tail)
+			row[mask.mWords - 1] = (row[mask.mWords - 1] & ((uint64_t(1) << tail) - 1)) | (fill << tail);
+
+		// runs[b] covers the padded row's bits [b, b + length); result[b] covers [b, b + done)
+		shift_bits(&row[0], mask.mWords, &runs[0], words, -ptrdiff_t(before), fill);
+		std::fill(result.begin(), result.end(), fill);
+
+		size_t length = 1;
+		size_t done = 0;
+
+		for (size_t remaining = size; remaining; remaining >>= 1) {
+			if (remaining & 1) {
+				shift_bits(&runs[0], words, &shifted[0], words, ptrdiff_t(done), fill);
+				for (size_t i = 0; i < words; ++i)
+					result[i] = op(result[i], shifted[i]);
+				done += length;
+			}
+
+			if (remaining > 1) {
+				shift_bits(&runs[0], words, &shifted[0], words, ptrdiff_t(length), fill);
+				for (size_t i = 0; i < words; ++i)
+					runs[i] = op(runs[i], shifted[i]);
+				length *= 2;
+			}
+		}
+
+		std::copy(result.begin(), result.begin() + ptrdiff_t(mask.mWords), bits);
+		if (tail)
+			bits[mask.mWords - 1] &= (uint64_t(1) << tail) - 1;
+	}
+}
+
+template <typename op_t, typename Tint>
+static inline bitmask<Tint> morphology(const bitmask<Tint>& src, Tint width, Tint height, execution policy)
+{
+	bitmask<Tint> dst(src);
+
+	if (dst.mWidth <= 0 || dst.mHeight <= 0)
+		return dst;
+
+	size_t size = size_t(std::max(width, Tint(1)));
+	size_t before;
+	clip_window<op_t>(size_t(dst.mWidth), size, before);
+
+	if (size > 1) {
+		for_each_band(dst.mHeight, policy, [&](Tint y0, Tint y1) {
+			bitmask_rows<op_t>(dst, size, before, y0, y1);
+		});
+	}
+
+	size = size_t(std::max(height, Tint(1)));
+	clip_window<op_t>(size_t(dst.mHeight), size, before);
+
+	if (size > 1) {
+		for_each_band(Tint(dst.mWords), policy, [&](Tint i0, Tint i1) {
+			const size_t lanes = size_t(i1 - i0);
+			memory::aligned_vector<uint64_t> forward((size_t(dst.mHeight) + size - 1) * lanes);
+			memory::aligned_vector<uint64_t> backward((size_t(dst.mHeight) + size - 1) * lanes);
+
+			van_herk(&dst.mBits[size_t(i0)], ptrdiff_t(dst.mWords), size_t(dst.mHeight), lanes, before, size,
+					 &forward[0], &backward[0], op_t());
+		}, Tint(8));
+	}
+
+	return dst;
+}
+
+} // namespace detail
+
+// Binary morphology, as above: erode keeps the pixels whose whole window is set (pixels
+// past the edges count as set), and dilate sets those whose window has any set pixel.
+// Rows go 64 pixels to the instruction, so these are much quicker than their grey level
+// counterparts on a 0/255 image.
+template <typename Tint>
+bitmask<Tint> erode(const bitmask<Tint>& src, Tint width, Tint height, execution policy = execution::sequential)
+{
+	return detail::morphology<detail::and_op>(src, width, height, policy);
+}
+
+template <typename Tint>
+bitmask<Tint> dilate(const bitmask<Tint>& src, Tint width, Tint height, execution policy = execution::sequential)
+{
+	return detail::morphology<detail::or_op>(src, width, height, policy);
+}
+
+template <typename Tint>
+bitmask<Tint> opening(const bitmask<Tint>& src, Tint width, Tint height, execution policy = execution::sequential)
+{
+	return dilate(erode(src, width, height, policy), width, height, policy);
+}
+
+template <typename Tint>
+bitmask<Tint> closing(const bitmask<Tint>& src, Tint width, Tint height, execution policy = execution::sequential)
+{
+	return erode(dilate(src, width, height, policy), width, height, policy);
+}
+
+// The 3x3 derivative operators gradient knows. Both are a central difference across
+// the direction taken, smoothed with [1 2 1] (sobel) or [3 10 3] (scharr, which gets the
+// orientation of a gradient closer to right) along the other one.
+enum class gradient_operator
+{
+	sobel,
+	scharr
+};
+
+// What gradient finds at every pixel: the derivatives along x and y, the length of the
+// gradient they make up, and its direction. See gradient.
+template <typename Tint = int32_t>
+struct gradients
+{
+	data<float, color_format::greyscale, Tint> mX;
+	data<float, color_format::greyscale, Tint> mY;
+	data<float, color_format::greyscale, Tint> mMagnitude;
+	data<uint8_t, color_format::greyscale, Tint> mOrientation;
+};
+
+namespace detail {
+
+template <typename image_t>
+static inline void gradient_rows(const image_t& src, gradients<typename image_t::int_t>& dst, float side, float centre,
+								 const border& edges, typename image_t::int_t y0, typename image_t::int_t y1)
+{
+	using int_t = typename image_t::int_t;
+
+	const auto kernel = simd::kernels().mGradient;
+	row_window<3, image_t> window(src, edges);
+
+	for (int_t y = y0; y < y1; ++y) {
+		const float* above = window.row(y - 1);
+		const float* row = window.row(y);
+		const float* below = window.row(y + 1);
+
+		kernel(above, row, below, side, centre, row_data(dst.mX, y), row_data(dst.mY, y), row_data(dst.mMagnitude, y),
+			   row_data(dst.mOrientation, y), size_t(src.mWidth));
+	}
+}
+
+} // namespace detail
+
+// The gradient of a greyscale image, all of it in one pass: every source row is converted
+// to floats once, and a single SIMD kernel (simd::row_kernels::mGradient) takes the three
+// rows around an output row to its x and y derivatives, magnitude and orientation, rather
+// than two apply_kernel calls and another loop to combine what they wrote.
+//
+// The derivatives are of normalized channel values (as apply_kernel normalizes them), per
+// pixel, with y going down the image: a sharp edge from black to white gives a magnitude
+// of 0.5 on either side of it. The orientation is that of the gradient rounded to the nearest
+// of 8 directions, 45 degrees apart: 0 is along +x, 2 along +y (down), 4 along -x and 6
+// along -y, so the edge itself runs across it. Flat areas get 0. Edges are clamped unless
+// another border is given. Any channel type works, and views are fine too.
+template <typename image_t>
+gradients<typename image_t::int_t> gradient(const image_t& src, gradient_operator op = gradient_operator::sobel,
+											execution policy = execution::sequential,
+											const border& edges = border(border_mode::clamp))
+{
+	using int_t = typename image_t::int_t;
+	using float_t = data<float, color_format::greyscale, int_t>;
+	using byte_t = data<uint8_t, color_format::greyscale, int_t>;
+
+	static_assert(image_t::NUM_CHANNELS == 1 && image_t::LAYOUT == layout::interleaved,
+				  "gradient takes interleaved greyscale images");
+
+	gradients<int_t> dst;
+	dst.mX = make_image<float_t>(src.mWidth, src.mHeight, typename float_t::pixel_t());
+	dst.mY = make_image<float_t>(src.mWidth, src.mHeight, typename float_t::pixel_t());
+	dst.mMagnitude = make_image<float_t>(src.mWidth, src.mHeight, typename float_t::pixel_t());
+	dst.mOrientation = make_image<byte_t>(src.mWidth, src.mHeight, typename byte_t::pixel_t());
+
+	// Weights for s(x) in simd::row_kernels::mGradient, with the halving of the central
+	// difference folded in; each smoothing kernel sums to 1 before it.
+	const float side = op == gradient_operator::scharr ? 3.0f / 32.0f : 1.0f / 8.0f;
+	const float centre = op == gradient_operator::scharr ? 10.0f / 32.0f : 2.0f / 8.0f;
+
+	if (src.mWidth > 0) {
+		for_each_band(src.mHeight, policy, [&](int_t y0, int_t y1) {
+			detail::gradient_rows(src, dst, side, centre, edges, y0, y1);
+		});
+	}
+
+	return dst;
+}
+
+namespace detail {
+
+// netpbm rows in and out of any channel type. Halves go through floats, and
+// aren't clamped on the way in, like floats.
+template <typename channel_t>
+static inline bool read_row(netpbm::reader& src, channel_t* dst, memory::aligned_vector<float>&)
+{
+	return src.read_row(dst);
+}
+
+static inline bool read_row(netpbm::reader& src, half* dst, memory::aligned_vector<float>& scratch)
+{
+	if (!src.read_row(&scratch[0]))
+		return false;
+
+	for (size_t i = 0; i < scratch.size(); ++i)
+		dst[i] = half(scratch[i]);
+
+	return true;
+}
+
+template <typename channel_t>
+static inline bool write_row(netpbm::writer& dst, const channel_t* src, memory::aligned_vector<float>&)
+{
+	return dst.write_row(src);
+}
+
+static inline bool write_row(netpbm::writer& dst, const half* src, memory::aligned_vector<float>& scratch)
+{
+	for (size_t i = 0; i < scratch.size(); ++i)
+		scratch[i] = float(src[i]);
+
+	return dst.write_row(&scratch[0]);
+}
+
+// The scratch row the above need, if any.
+template <typename channel_t>
+static inline memory::aligned_vector<float> row_scratch(size_t count)
+{
+	return memory::aligned_vector<float>(std::is_same<channel_t, half>::value ? count : 0);
+}
+
+// A netpbm file being read, made to look like an image to the row engines (like plane_ref
+// does for planes). Rows are read as they're asked for, and the last mCapacity of them
+// are kept around, which is enough for anything that only ever looks a window of that
+// many rows back from the furthest row it's asked for. Rows past the end of a short
+// file are zeros, and mFailed is set.
+template <typename Tchannel, color_format Eformat, typename Tint>
+struct stream_source
+{
+	using channel_t = Tchannel;
+	using int_t = Tint;
+
+	static const size_t PIXEL_STRIDE = (size_t)Eformat;
+
+	int_t mWidth;
+	int_t mHeight;
+	netpbm::reader& mReader;
+	int_t mCapacity;
+	size_t mRowLength;
+
+	// Reading rows doesn't change the image they make up
+	mutable memory::aligned_vector<Tchannel> mRows;
+	mutable memory::aligned_vector<float> mScratch;
+	mutable int_t mNext;
+	mutable bool mFailed;
+
+	stream_source(netpbm::reader& reader, size_t capacity)
+		: mWidth(int_t(reader.width())),
+		  mHeight(int_t(reader.height())),
+		  mReader(reader),
+		  mCapacity(int_t(capacity)),
+		  mRowLength(aligned_stride(size_t(reader.width()) * PIXEL_STRIDE, sizeof(Tchannel))),
+		  mRows(mRowLength * capacity),
+		  mScratch(row_scratch<Tchannel>(size_t(reader.width()) * PIXEL_STRIDE)),
+		  mNext(0),
+		  mFailed(false)
+	{}
+
+	Tchannel* row(int_t y) const
+	{
+		for (; mNext <= y; ++mNext) {
+			Tchannel* dst = &mRows[size_t(mNext % mCapacity) * mRowLength];
+			if (!read_row(mReader, dst, mScratch)) {
+				std::fill(dst, dst + size_t(mWidth) * PIXEL_STRIDE, Tchannel(0));
+				mFailed = true;
+			}
+		}
+
+		return &mRows[size_t(y % mCapacity) * mRowLength];
+	}
+};
+
+template <typename Tchannel, color_format Eformat, typename Tint>
+static inline Tchannel* row_data(const stream_source<Tchannel, Eformat, Tint>& src, Tint y)
+{
+	return src.row(y);
+}
+
+// The other end: a netpbm file being written, row by row, in order. A row is written
+// once the next one is asked for, or by flush.
+template <typename Tchannel, color_format Eformat, typename Tint>
+struct stream_sink
+{
+	using channel_t = Tchannel;
+	using int_t = Tint;
+
+	static const size_t PIXEL_STRIDE = (size_t)Eformat;
+
+	int_t mWidth;
+	int_t mHeight;
+	netpbm::writer& mWriter;
+	memory::aligned_vector<Tchannel> mRow;
+	memory::aligned_vector<float> mScratch;
+	bool mPending;
+	bool mFailed;
+
+	stream_sink(netpbm::writer& writer)
+		: mWidth(int_t(writer.width())),
+		  mHeight(int_t(writer.height())),
+		  mWriter(writer),
+		  mRow(size_t(writer.width()) * PIXEL_STRIDE),
+		  mScratch(row_scratch<Tchannel>(mRow.size())),
+		  mPending(false),
+		  mFailed(false)
+	{}
+
+	Tchannel* row(void)
+	{
+		flush();
+		mPending = true;
+		return &mRow[0];
+	}
+
+	void flush(void)
+	{
+		if (mPending && !write_row(mWriter, &mRow[0], mScratch))
+			mFailed = true;
+
+		mPending = false;
+	}
+};
+
+template <typename Tchannel, color_format Eformat, typename Tint>
+static inline Tchannel* row_data(stream_sink<Tchannel, Eformat, Tint>& dst, Tint)
+{
+	return dst.row();
+}
+
+template <typename channel_t, color_format Eformat, typename kernel_t>
+static inline bool convolve_stream(netpbm::reader& src, netpbm::writer& dst, const kernel_t& k, size_t size,
+								   const border& edges, arithmetic math)
+{
+	stream_source<channel_t, Eformat, int32_t> source(src, size);
+	stream_sink<channel_t, Eformat, int32_t> sink(dst);
+
+	convolve(source, sink, k, execution::sequential, edges, math);
+	sink.flush();
+
+	return !source.mFailed && !sink.mFailed;
+}
+
+// Picks the channel type and format for a streamed convolution. The source's
+// own channel type is used all the way through, as apply_kernel would.
+template <typename kernel_t>
+static inline bool convolve_stream(netpbm::reader& src, netpbm::writer& dst, const kernel_t& k, size_t size,
+								   const border& edges, arithmetic math)
+{
+	if (edges.mMode == border_mode::wrap || src.width() != dst.width() || src.height() != dst.height() ||
+		src.channels() != dst.channels() || src.next_row() != 0 || dst.next_row() != 0)
+		return false;
+
+	const bool rgb = src.channels() == 3;
+
+	switch (src.samples()) {
+	case netpbm::sample_type::u8:
+		return rgb ? convolve_stream<uint8_t, color_format::rgb>(src, dst, k, size, edges, math)
+				   : convolve_stream<uint8_t, color_format::greyscale>(src, dst, k, size, edges, math);
+	case netpbm::sample_type::u16:
+		return rgb ? convolve_stream<uint16_t, color_format::rgb>(src, dst, k, size, edges, math)
+				   : convolve_stream<uint16_t, color_format::greyscale>(src, dst, k, size, edges, math);
+	default:
+		return rgb ? convolve_stream<float, color_format::rgb>(src, dst, k, size, edges, math)
+				   : convolve_stream<float, color_format::greyscale>(src, dst, k, size, edges, math);
+	}
+}
+
+} // namespace detail
+
+// Reads the next dst.mHeight rows of a netpbm file into dst (see netpbm::reader for how
+// channels are converted), so that an image bigger than memory can be worked on a band at a
+// time. Returns false, having read what there was, if dst isn't as wide as the file, has
+// another number of channels, or reaches past its last row.
+IMG_DEF bool read_rows(netpbm::reader &src, const IMG_VIEW_TMPL &dst)
+{
+	using channel_t = typename IMG_VIEW_TMPL::channel_t;
+
+	if (uint32_t(dst.mWidth) != src.width() || (uint32_t)Eformat != src.channels())
+		return false;
+
+	memory::aligned_vector<float> scratch(detail::row_scratch<channel_t>(size_t(dst.mWidth) * (size_t)Eformat));
+
+	for (IMG_INT_TYPE y = 0; y < dst.mHeight; ++y)
+		if (!detail::read_row(src, detail::row_data(dst, y), scratch))
+			return false;
+
+	return true;
+}
+
+IMG_DEF bool read_rows(netpbm::reader &src, IMG_DATA_TMPL &dst)
+{
+	return read_rows(src, make_view(dst));
+}
+
+// The other way around: writes src's rows as the next src.mHeight rows of a netpbm file.
+// A whole image at once is write_rows(writer, image) after opening writer with its size.
+IMG_DEF bool write_rows(netpbm::writer &dst, const IMG_VIEW_TMPL &src)
+{
+	using channel_t = typename IMG_VIEW_TMPL::channel_t;
+
+	if (uint32_t(src.mWidth) != dst.width() || (uint32_t)Eformat != dst.channels())
+		return false;
+
+	memory::aligned_vector<float> scratch(detail::row_scratch<channel_t>(size_t(src.mWidth) * (size_t)Eformat));
+
+	for (IMG_INT_TYPE y = 0; y < src.mHeight; ++y)
+		if (!detail::write_row(dst, detail::row_data(src, y), scratch))
+			return false;
+
+	return true;
+}
+
+IMG_DEF bool write_rows(netpbm::writer &dst, const IMG_DATA_TMPL &src)
+{
+	return write_rows(dst, make_view(src));
+}
+
+// Convolves a whole netpbm file into another one without either of them ever being in
+// memory: source rows are read as the kernel reaches them and only the last N are kept,
+// so memory use is a few rows' worth (N of them, as channels and as floats), whatever the height.
+// Results are the same as apply_kernel's on the same image. src and dst have to be open,
+// with nothing read from or written to them yet, and the same size and number of
+// channels; the arithmetic is in src's channel type, and dst converts the results to
+// its own. Rows are only ever read going down, so border_mode::wrap, which needs the
+// other end of the image, isn't available; the default here is clamp. Returns false if
+// any of this doesn't hold, or if reading or writing fails; dst isn't closed either way.
+template <size_t N>
+bool apply_kernel(netpbm::reader& src, netpbm::writer& dst, const kernel<N>& k,
+				  const border& edges = border(border_mode::clamp), arithmetic math = arithmetic::floating_point)
+{
+	return detail::convolve_stream(src, dst, k, N, edges, math);
+}
+
+template <size_t N>
+bool apply_kernel(netpbm::reader& src, netpbm::writer& dst, const separable_kernel<N>& k,
+				  const border& edges = border(border_mode::clamp), arithmetic math = arithmetic::floating_point)
+{
+	return detail::convolve_stream(src, dst, k, N, edges, math);
+}
+
+static inline bool apply_kernel(netpbm::reader& src, netpbm::writer& dst, const glm::mat3& k,
+								const border& edges = border(border_mode::clamp),
+								arithmetic math = arithmetic::floating_point)
+{
+	return detail::convolve_stream(src, dst, to_kernel(k), 3, edges, math);
+}
+
+namespace detail {
+
+// The horizontal half of a resize, spelled out per channel: mResample sees a row of
+// interleaved pixels as a flat run of channels, each with its own first source channel.
+struct channel_taps
+{
+	size_t mTaps;
+	memory::aligned_vector<int32_t> mOffsets; // per output channel, in channels
+	memory::aligned_vector<float> mWeights; // tap major: one run of per channel weights per tap
+
+	channel_taps(const resample_table& table, size_t stride)
+		: mTaps(table.mTaps),
+		  mOffsets(table.mFirst.size() * stride),
+		  mWeights(table.mFirst.size() * stride * table.mTaps)
+	{
+		const size_t count = mOffsets.size();
+
+		for (size_t x = 0; x < table.mFirst.size(); ++x) {
+			for (size_t c = 0; c < stride; ++c) {
+				const size_t i = x * stride + c;
+				mOffsets[i] = int32_t(size_t(table.mFirst[x]) * stride + c);
+				for (size_t t = 0; t < mTaps; ++t)
+					mWeights[t * count + i] = table.mWeights[x * mTaps + t];
+			}
+		}
+	}
+};
+
+// Resamples rows [y0, y1) of dst out of src. Like convolve_rows_separable, this keeps a
+// window of source rows which have already been resampled horizontally, so each source
+// row is converted and filtered once and then blended into every output row which uses it.
+template <typename image_t, typename dst_t>
+static inline void resize_rows(const image_t& src, dst_t& dst, const resample_table& columns,
+							   const resample_table& rows, typename dst_t::int_t y0, typename dst_t::int_t y1)
+{
+	using int_t = typename dst_t::int_t;
+
+	const simd::row_kernels& rk = simd::kernels();
+	const size_t stride = image_t::PIXEL_STRIDE;
+	const size_t srcCount = size_t(src.mWidth) * stride;
+	const size_t count = size_t(dst.mWidth) * stride;
+	const size_t rowLength = aligned_stride(count, sizeof(float));
+	const size_t taps = rows.mTaps;
+
+	const channel_taps horizontal(columns, stride);
+
+	memory::aligned_vector<float> source(srcCount);
+	memory::aligned_vector<float> filtered(rowLength * taps);
+	memory::aligned_vector<float> accum(count);
+	std::vector<int_t> loaded(taps, std::numeric_limits<int_t>::min());
+
+	for (int_t y = y0; y < y1; ++y) {
+		std::fill(accum.begin(), accum.end(), 0.0f);
+
+		const float* weights = &rows.mWeights[size_t(y) * taps];
+
+		for (size_t t = 0; t < taps; ++t) {
+			if (weights[t] == 0.0f)
+				continue;
+
+			int_t sy = int_t(rows.mFirst[y] + int32_t(t));
+			size_t slot = size_t(sy) % taps;
+			float* row = &filtered[slot * rowLength];
+
+			if (loaded[slot] != sy) {
+				load_channels(row_data(src, sy), &source[0], srcCount);
+				rk.mResample(&source[0], &horizontal.mOffsets[0], &horizontal.mWeights[0], horizontal.mTaps, stride,
+							 row, count);
+				loaded[slot] = sy;
+			}
+
+			rk.mMulAdd(&accum[0], row, weights[t], count);
+		}
+
+		store_channels(&accum[0], row_data(dst, y), count);
+	}
+}
+
+// Adds fy rows of src, starting at row y, onto sums. 8 bit rows are summed exactly,
+// in integers: they're widened and then added two at a time by the fixed point kernel.
+template <typename image_t>
+static inline void sum_rows(const image_t& src, typename image_t::int_t y, size_t fy, int32_t* sums,
+							int16_t* scratch, size_t count)
+{
+	using int_t = typename image_t::int_t;
+
+	const simd::row_kernels& rk = simd::kernels();
+
+	for (size_t r = 0; r < fy; r += 2) {
+		const int16_t* a = scratch;
+		const int16_t* b = scratch + count;
+
+		rk.mLoadU8ToI16(row_data(src, y + int_t(r)), scratch, count);
+		if (r + 1 < fy) {
+			rk.mLoadU8ToI16(row_data(src, y + int_t(r + 1)), scratch + count, count);
+			rk.mMulAdd2I16(sums, a, b, 1, 1, count);
+		} else {
+			rk.mMulAdd2I16(sums, a, a, 1, 0, count);
+		}
+	}
+}
+
+// Float rows are summed where they are; anything else is converted into scratch first.
+static inline const float* float_row(const float* row, float*, size_t)
+{
+	return row;
+}
+
+template <typename channel_t>
+static inline const float* float_row(const channel_t* row, float* scratch, size_t count)
+{
+	load_channels(row, scratch, count);
+	return scratch;
+}
+
+template <typename image_t>
+static inline void sum_rows(const image_t& src, typename image_t::int_t y, size_t fy, float* sums, float* scratch,
+							size_t count)
+{
+	using int_t = typename image_t::int_t;
+
+	for (size_t r = 0; r < fy; ++r)
+		simd::kernels().mMulAdd(sums, float_row(row_data(src, y + int_t(r)), scratch, count), 1.0f, count);
+}
+
+// Turns the sum of a block's channels into their average; 8 bit averages are rounded to
+// nearest. 16 bit and half channels are summed as normalized floats, like float ones,
+// and 16 bit averages are rounded to nearest too. An integer divide per channel shows up
+// in profiles here, so 8 bit sums are multiplied by a fixed point reciprocal with 52
+// fractional bits instead. That gives the exact quotient as long as sum * (n - 1) < 2^52,
+// which holds for every sum a block of up to MAX_COUNT pixels can produce.
+struct box_average
+{
+	static const int32_t MAX_COUNT = int32_t(1) << 22;
+
+	int32_t mCount;
+	uint64_t mReciprocal; // ceil(2^52 / mCount)
+
+	explicit box_average(int32_t count)
+		: mCount(count),
+		  mReciprocal(((uint64_t(1) << 52) + uint64_t(count) - 1) / uint64_t(count))
+	{}
+
+	uint8_t operator()(int32_t sum, uint8_t*) const
+	{
+		return uint8_t((uint64_t(sum + mCount / 2) * mReciprocal) >> 52);
+	}
+
+	float operator()(float sum, float*) const
+	{
+		return sum / float(mCount);
+	}
+
+	uint16_t operator()(float sum, uint16_t*) const
+	{
+		return uint16_t(std::min(sum / float(mCount), 1.0f) * 65535.0f + 0.5f);
+	}
+
+	half operator()(float sum, half*) const
+	{
+		return half(sum / float(mCount));
+	}
+};
+
+// The integer factor box downscale: every output pixel is the average of an fx * fy
+// block of source pixels. Rows of a block are summed with the row kernels, and then
+// each block's columns are added up.
+template <typename image_t, typename dst_t>
+static inline void downscale_box_rows(const image_t& src, dst_t& dst, size_t fx, size_t fy,
+									  typename dst_t::int_t y0, typename dst_t::int_t y1)
+{
+	using int_t = typename dst_t::int_t;
+	using channel_t = typename dst_t::channel_t;
+	using sum_t = typename std::conditional<std::is_same<channel_t, uint8_t>::value, int32_t, float>::type;
+	using scratch_t = typename std::conditional<std::is_same<channel_t, uint8_t>::value, int16_t, float>::type;
+
+	constexpr size_t stride = image_t::PIXEL_STRIDE;
+	const size_t srcCount = size_t(src.mWidth) * stride;
+	const box_average average(int32_t(fx * fy));
+
+	memory::aligned_vector<sum_t> sums(srcCount);
+	memory::aligned_vector<scratch_t> scratch(2 * srcCount);
+
+	for (int_t y = y0; y < y1; ++y) {
+		std::fill(sums.begin(), sums.end(), sum_t(0));
+		sum_rows(src, int_t(size_t(y) * fy), fy, &sums[0], &scratch[0], srcCount);
+
+		channel_t* out = row_data(dst, y);
+		const sum_t* block = &sums[0];
+
+		for (int_t x = 0; x < dst.mWidth; ++x, out += stride) {
+			std::array<sum_t, stride> sum;
+			sum.fill(sum_t(0));
+
+			for (size_t j = 0; j < fx; ++j, block += stride) {
+				for (size_t c = 0; c < stride; ++c)
+					sum[c] += block[c];
+			}
+
+			for (size_t c = 0; c < stride; ++c)
+				out[c] = average(sum[c], out);
+		}
+	}
+}
+
+// All of resize, bar allocating dst.
+template <typename image_t, typename dst_t>
+static inline void resize_into(const image_t& src, dst_t& dst, resize_filter filter, execution policy)
+{
+	using int_t = typename dst_t::int_t;
+
+	if (src.mWidth <= 0 || src.mHeight <= 0 || dst.mWidth <= 0 || dst.mHeight <= 0)
+		return;
+
+	const size_t fx = size_t(src.mWidth / dst.mWidth);
+	const size_t fy = size_t(src.mHeight / dst.mHeight);
+
+	if (filter == resize_filter::box && src.mWidth % dst.mWidth == 0 && src.mHeight % dst.mHeight == 0 &&
+		fx * fy <= size_t(box_average::MAX_COUNT)) {
+		for_each_row_band(src, dst, policy, [&](const auto& s, auto& d, int_t y0, int_t y1) {
+			downscale_box_rows(s, d, fx, fy, y0, y1);
+		});
+		return;
+	}
+
+	const std::shared_ptr<const resample_table> columns(resample_weights(size_t(src.mWidth), size_t(dst.mWidth), filter));
+	const std::shared_ptr<const resample_table> rows(resample_weights(size_t(src.mHeight), size_t(dst.mHeight), filter));
+
+	for_each_row_band(src, dst, policy, [&](const auto& s, auto& d, int_t y0, int_t y1) {
+		resize_rows(s, d, *columns, *rows, y0, y1);
+	});
+}
+
+} // namespace detail
+
+// Resamples an image to width x height with a separable filter; the result is a new image.
+// Source pixels past the edges are clamped to them. Like apply_kernel, all of the math is
+// done in normalized floats and results are clamped to [0, 1], so the overshoot of bicubic
+// and lanczos3 doesn't wrap around. Box filtered downscales by whole factors (e.g. halving)
+// skip the weight tables and just average blocks of pixels. Both layouts and views work.
+template <typename image_t>
+typename detail::owner<image_t>::type resize(const image_t& src, typename image_t::int_t width,
+											 typename image_t::int_t height,
+											 resize_filter filter = resize_filter::bicubic,
+											 execution policy = execution::sequential)
+{
+	using result_t = typename detail::owner<image_t>::type;
+
+	result_t dst(make_image<result_t>(width, height, typename result_t::pixel_t()));
+	detail::resize_into(src, dst, filter, policy);
+
+	return dst;
+}
+
+// The same again, but the result goes into dst (which decides the size) instead of a new image.
+// src is an interleaved image or view, and may overlap dst.
+template <typename image_t, typename Tchannel, color_format Eformat, typename Tint>
+void resize(const image_t& src, const IMG_VIEW_TMPL& dst, resize_filter filter = resize_filter::bicubic,
+			execution policy = execution::sequential)
+{
+	detail::with_unaliased(src, dst, [&](const auto& source, auto& target) {
+		detail::resize_into(source, target, filter, policy);
+	});
+}
+
+// How an image's channel values relate to light. Most 8 bit colour images (photos,
+// and textures painted for display) are srgb encoded; averaging those values as they are
+// darkens and shifts colours, so operations which know about this work in linear light.
+enum class encoding
+{
+	linear,
+	srgb
+};
+
+namespace detail {
+
+// One side of the next mip level down: halved and rounded down, but never below 1,
+// which is how GL sizes levels.
+template <typename int_t>
+static inline int_t mip_extent(int_t extent)
+{
+	return extent > 1 ? extent / 2 : 1;
+}
+
+} // namespace detail
+
+// Colour models an rgb image's three channels (or an rgba image's first three) can
+// hold, besides plain rgb:
+//  - ycbcr: luma and two colour differences, full range (as in JPEG/JFIF). Cb and Cr
+//    are offset by one half, so every channel is in [0, 1]
+//  - hsv: hue (as a fraction of a turn, so red is 0), saturation and value
+// color_format can't tell these apart, so they're stored in rgb images as they are,
+// and it's up to whoever holds one to know which model it's in.
+enum class color_model
+{
+	rgb,
+	ycbcr,
+	hsv
+};
+
+namespace detail {
+
+// Everything convert does between reading channels and writing them.
+struct conversion
+{
+	encoding mFromEncoding;
+	encoding mToEncoding;
+	color_model mFromModel;
+	color_model mToModel;
+};
+
+// Row y of every channel of src. Planar images hand out their planes; anything
+// interleaved is split up into scratch (C rows of stride channels) first.
+template <typename image_t>
+static inline std::array<const typename image_t::channel_t*, image_t::NUM_CHANNELS>
+source_rows(const image_t& src, typename image_t::int_t y, typename image_t::channel_t* scratch, size_t stride)
+{
+	std::array<typename image_t::channel_t*, image_t::NUM_CHANNELS> rows;
+	for (size_t c = 0; c < rows.size(); ++c)
+		rows[c] = scratch + c * stride;
+
+	deinterleave_row<image_t::NUM_CHANNELS>(row_data(src, y), rows, size_t(src.mWidth));
+
+	std::array<const typename image_t::channel_t*, image_t::NUM_CHANNELS> result;
+	std::copy(rows.begin(), rows.end(), result.begin());
+	return result;
+}
+
+IMG_DEF std::array<const Tchannel*, (size_t)Eformat> source_rows(const IMG_PLANAR_TMPL& src, IMG_INT_TYPE y,
+																 Tchannel*, size_t)
+{
+	return plane_rows(src, y);
+}
+
+// Where row y of every channel of dst gets written, and the step which puts
+// it in place afterwards (interleaving it, for interleaved images).
+IMG_DEF std::array<Tchannel*, (size_t)Eformat> target_rows(IMG_DATA_TMPL&, IMG_INT_TYPE, Tchannel* scratch,
+														   size_t stride)
+{
+	std::array<Tchannel*, (size_t)Eformat> rows;
+	for (size_t c = 0; c < rows.size(); ++c)
+		rows[c] = scratch + c * stride;
+	return rows;
+}
+
+IMG_DEF std::array<Tchannel*, (size_t)Eformat> target_rows(IMG_PLANAR_TMPL& dst, IMG_INT_TYPE y, Tchannel*, size_t)
+{
+	return plane_rows(dst, y);
+}
+
+IMG_DEF void finish_rows(IMG_DATA_TMPL& dst, IMG_INT_TYPE y, const std::array<Tchannel*, (size_t)Eformat>& rows)
+{
+	std::array<const Tchannel*, (size_t)Eformat> source;
+	std::copy(rows.begin(), rows.end(), source.begin());
+	interleave_row<(size_t)Eformat>(source, row_data(dst, y), size_t(dst.mWidth));
+}
+
+IMG_DEF void finish_rows(IMG_PLANAR_TMPL&, IMG_INT_TYPE, const std::array<Tchannel*, (size_t)Eformat>&)
+{}
+
+// Normalized floats in and out of any channel type, optionally through srgb. 8 bit
+// channels have tables of their own; anything else is decoded once it's a float, or
+// encoded (in place, so src is clobbered) before it's stored.
+template <typename channel_t>
+static inline void load_values(const channel_t* src, float* dst, size_t count, bool decode)
+{
+	load_channels(src, dst, count);
+	if (decode)
+		srgb::decode(dst, dst, count);
+}
+
+static inline void load_values(const uint8_t* src, float* dst, size_t count, bool decode)
+{
+	if (decode)
+		srgb::decode(src, dst, count);
+	else
+		load_channels(src, dst, count);
+}
+
+template <typename channel_t>
+static inline void store_values(float* src, channel_t* dst, size_t count, bool encode)
+{
+	if (encode)
+		srgb::encode(src, src, count);
+	store_channels(src, dst, count);
+}
+
+static inline void store_values(float* src, uint8_t* dst, size_t count, bool encode)
+{
+	if (encode)
+		srgb::encode(src, dst, count);
+	else
+		store_channels(src, dst, count);
+}
+
+// The hue, saturation and value of r, g and b, and back, in place.
+static inline void rgb_to_hsv(float& r, float& g, float& b)
+{
+	const float hi = std::max(r, std::max(g, b));
+	const float lo = std::min(r, std::min(g, b));
+	const float range = hi - lo;
+
+	float h = 0.0f;
+	if (range > 0.0f) {
+		if (hi == r)
+			h = (g - b) / range;
+		else if (hi == g)
+			h = (b - r) / range + 2.0f;
+		else
+			h = (r - g) / range + 4.0f;
+
+		h /= 6.0f;
+		if (h < 0.0f)
+			h += 1.0f;
+	}
+
+	r = h;
+	g = hi > 0.0f ? range / hi : 0.0f;
+	b = hi;
+}
+
+static inline void hsv_to_rgb(float& h, float& s, float& v)
+{
+	float sector = glm::clamp(h, 0.0f, 1.0f) * 6.0f;
+	if (sector >= 6.0f)
+		sector = 0.0f;
+
+	const int i = int(sector);
+	const float f = sector - float(i);
+	const float value = v;
+	const float p = value * (1.0f - s);
+	const float q = value * (1.0f - s * f);
+	const float t = value * (1.0f - s * (1.0f - f));
+
+	switch (i) {
+	case 0: h = value; s = t; v = p; break;
+	case 1: h = q; s = value; v = p; break;
+	case 2: h = p; s = value; v = t; break;
+	case 3: h = p; s = q; v = value; break;
+	case 4: h = t; s = p; v = value; break;
+	default: h = value; s = p; v = q; break;
+	}
+}
+
+// The colour channels of a row are rows[0, 3), and alpha is rows[3]; rows 4 and 5 are
+// spare, so that the linear models can be done a whole channel at a time and the
+// pointers swapped after.
+using conversion_rows = std::array<float*, 6>;
+
+static inline void combine_rows(conversion_rows& rows, const float (&weights)[3][4], size_t count)
+{
+	const simd::row_kernels& k = simd::kernels();
+
+	for (size_t c = 0; c < 3; ++c) {
+		float* dst = c < 2 ? rows[4 + c] : rows[2]; // the last one can overwrite its input
+		k.mCombine3(rows[0], rows[1], rows[2], weights[c][0], weights[c][1], weights[c][2], weights[c][3], dst,
+					count);
+	}
+
+	std::swap(rows[0], rows[4]);
+	std::swap(rows[1], rows[5]);
+}
+
+static inline void model_to_rgb(conversion_rows& rows, color_model model, size_t count)
+{
+	static const float FROM_YCBCR[3][4] = {
+		{ 1.0f, 0.0f, 1.402f, -0.701f },
+		{ 1.0f, -0.344136f, -0.714136f, 0.529136f },
+		{ 1.0f, 1.772f, 0.0f, -0.886f }
+	};
+
+	if (model == color_model::ycbcr) {
+		combine_rows(rows, FROM_YCBCR, count);
+	} else if (model == color_model::hsv) {
+		for (size_t i = 0; i < count; ++i)
+			hsv_to_rgb(rows[0][i], rows[1][i], rows[2][i]);
+	}
+}
+
+static inline void rgb_to_model(conversion_rows& rows, color_model model, size_t count)
+{
+	static const float TO_YCBCR[3][4] = {
+		{ 0.299f, 0.587f, 0.114f, 0.0f },
+		{ -0.168736f, -0.331264f, 0.5f, 0.5f },
+		{ 0.5f, -0.418688f, -0.081312f, 0.5f }
+	};
+
+	if (model == color_model::ycbcr) {
+		combine_rows(rows, TO_YCBCR, count);
+	} else if (model == color_model::hsv) {
+		for (size_t i = 0; i < count; ++i)
+			rgb_to_hsv(rows[0][i], rows[1][i], rows[2][i]);
+	}
+}
+
+// Rows of interleaved images with the same format can be converted as flat runs of channels.
+template <typename src_t, typename dst_t>
+static inline void convert_flat_rows(const src_t& src, dst_t& dst, bool decode, bool encode,
+									 typename dst_t::int_t y0, typename dst_t::int_t y1, std::true_type)
+{
+	memory::aligned_vector<float> values(size_t(dst.mWidth) * dst_t::NUM_CHANNELS);
+
+	for (typename dst_t::int_t y = y0; y < y1; ++y) {
+		load_values(row_data(src, y), values.data(), values.size(), decode);
+		store_values(values.data(), row_data(dst, y), values.size(), encode);
+	}
+}
+
+template <typename src_t, typename dst_t>
+static inline void convert_flat_rows(const src_t&, dst_t&, bool, bool, typename dst_t::int_t, typename dst_t::int_t,
+									 std::false_type)
+{}
+
+// Converts rows [y0, y1) of src into dst, which is the same size. Channels are loaded
+// into float rows (colours decoded on the way if need be), go through the colour model and
+// format changes, and are stored (and encoded) in dst's channel type. When that's all a
+// no-op (only the layout changes), channels are just copied; when only the channel
+// type or encoding does, and neither image is planar, rows are converted as
+// they are, with no splitting up (unless there's an alpha channel to keep out of the encoding).
+template <typename src_t, typename dst_t>
+static inline void convert_rows(const src_t& src, dst_t& dst, const conversion& how, typename dst_t::int_t y0,
+								typename dst_t::int_t y1)
+{
+	using int_t = typename dst_t::int_t;
+	using src_channel_t = typename src_t::channel_t;
+	using dst_channel_t = typename dst_t::channel_t;
+
+	const size_t S = src_t::NUM_CHANNELS;
+	const size_t D = dst_t::NUM_CHANNELS;
+
+	// Colour channels; alpha comes after them
+	const size_t SC = std::min(S, size_t(3));
+	const size_t DC = std::min(D, size_t(3));
+
+	const bool decode = how.mFromEncoding == encoding::srgb && how.mToEncoding == encoding::linear;
+	const bool encode = how.mFromEncoding == encoding::linear && how.mToEncoding == encoding::srgb;
+	const bool sameModel = SC != 3 || DC != 3 || how.mFromModel == how.mToModel;
+
+	const size_t width = size_t(dst.mWidth);
+
+	using interleaved = std::integral_constant<bool, src_t::LAYOUT == layout::interleaved &&
+														 dst_t::LAYOUT == layout::interleaved>;
+
+	if (S == D && sameModel && interleaved::value && (S < 4 || (!decode && !encode))) {
+		convert_flat_rows(src, dst, decode, encode, y0, y1, interleaved());
+		return;
+	}
+
+	const size_t stride = aligned_stride(width, sizeof(float));
+	memory::aligned_vector<src_channel_t> srcScratch(src_t::LAYOUT == layout::planar ? 0 : stride * S);
+	memory::aligned_vector<dst_channel_t> dstScratch(dst_t::LAYOUT == layout::planar ? 0 : stride * D);
+
+	const bool copy = S == D && sameModel && !decode && !encode && std::is_same<src_channel_t, dst_channel_t>::value;
+	if (copy) {
+		for (int_t y = y0; y < y1; ++y) {
+			const auto in = source_rows(src, y, srcScratch.data(), stride);
+			const auto out = target_rows(dst, y, dstScratch.data(), stride);
+
+			for (size_t c = 0; c < D; ++c)
+				memcpy(out[c], in[c], width * sizeof(dst_channel_t));
+
+			finish_rows(dst, y, out);
+		}
+		return;
+	}
+
+	memory::aligned_vector<float> values(stride * std::tuple_size<conversion_rows>::value);
+
+	for (int_t y = y0; y < y1; ++y) {
+		conversion_rows rows;
+		for (size_t c = 0; c < rows.size(); ++c)
+			rows[c] = &values[c * stride];
+
+		const auto in = source_rows(src, y, srcScratch.data(), stride);
+		for (size_t c = 0; c < S; ++c)
+			load_values(in[c], rows[c], width, decode && c < SC);
+
+		if (SC == 3 && DC == 1) {
+			model_to_rgb(rows, how.mFromModel, width);
+			simd::kernels().mCombine3(rows[0], rows[1], rows[2], 0.299f, 0.587f, 0.114f, 0.0f, rows[0], width);
+		} else if (SC == 1 && DC == 3) {
+			memcpy(rows[1], rows[0], width * sizeof(float));
+			memcpy(rows[2], rows[0], width * sizeof(float));
+			rgb_to_model(rows, how.mToModel, width);
+		} else if (!sameModel) {
+			model_to_rgb(rows, how.mFromModel, width);
+			rgb_to_model(rows, how.mToModel, width);
+		}
+
+		if (D == 4 && S != 4)
+			std::fill(rows[3], rows[3] + width, 1.0f);
+
+		const auto out = target_rows(dst, y, dstScratch.data(), stride);
+		for (size_t c = 0; c < D; ++c)
+			store_values(rows[c], out[c], width, encode && c < DC);
+
+		finish_rows(dst, y, out);
+	}
+}
+
+template <typename dst_t, typename image_t>
+static inline dst_t convert(const image_t& src, const conversion& how, execution policy)
+{
+	dst_t dst(make_image<dst_t>(src.mWidth, src.mHeight, typename dst_t::pixel_t()));
+
+	for_each_band(dst.mHeight, policy, [&](typename dst_t::int_t y0, typename dst_t::int_t y1) {
+		convert_rows(src, dst, how, y0, y1);
+	});
+
+	return dst;
+}
+
+} // namespace detail
+
+// Converts an image (or a view) to another type: dst_t may have a different channel
+// type, format or layout, in any combination, e.g. convert<greyscale_u8_t>(rgb) or
+// convert<rgb_planar_f32_t>(rgb). 8 and 16 bit channels are normalized to [0, 1] as
+// floats (halves are floats already), and floats are clamped to [0, 1] and scaled back;
+// rgb becomes greyscale through its Rec. 601 luma (0.299 r + 0.587 g + 0.114 b, like JPEG
+// and stb_image), and greyscale becomes rgb by repeating the channel. Alpha is dropped,
+// or comes out as 1 when src has none.
+//
+// The work is done a row at a time, in floats, with the SIMD kernels (see simd.h);
+// plain channel type changes of interleaved images skip splitting up channels,
+// and layout changes alone are copies.
+template <typename dst_t, typename image_t>
+dst_t convert(const image_t& src, execution policy = execution::sequential)
+{
+	return detail::convert<dst_t>(src, detail::conversion { encoding::linear, encoding::linear, color_model::rgb,
+															color_model::rgb }, policy);
+}
+
+// The same, but changing the encoding too: srgb to linear decodes src's values (8 bit
+// channels through a table), linear to srgb encodes the result (see srgb.h). The rest of
+// the conversion happens on the values src holds, decoded or not; luma from
+// srgb encoded rgb, for one, is the usual gamma encoded Y'.
+template <typename dst_t, typename image_t>
+dst_t convert(const image_t& src, encoding from, encoding to, execution policy = execution::sequential)
+{
+	return detail::convert<dst_t>(src, detail::conversion { from, to, color_model::rgb, color_model::rgb }, policy);
+}
+
+// Moves the channels of an rgb (or rgba) image from one colour model to another (see
+// color_model); the result is the same type of image, with alpha as it was. ycbcr is
+// all SIMD; hsv is done a pixel at a time.
+template <typename image_t>
+typename detail::owner<image_t>::type convert(const image_t& src, color_model from, color_model to,
+											  execution policy = execution::sequential)
+{
+	static_assert(image_t::NUM_CHANNELS >= 3, "colour models need rgb or rgba images");
+
+	using result_t = typename detail::owner<image_t>::type;
+
+	return detail::convert<result_t>(src, detail::conversion { encoding::linear, encoding::linear, from, to },
+									 policy);
+}
+
+// Builds the mip levels below base: level n + 1 is level n resized to half its size
+// (see detail::mip_extent), down to 1x1, or until maxLevels of them exist if that's
+// given. The result doesn't include base itself, so result[0] is level 1.
+//
+// Each level is filtered from the one above it with resize: box averages 2x2 blocks
+// (exactly, for even sizes), while kaiser (or any other resize_filter) trades a little
+// time for noticeably less aliasing. With encoding::srgb the chain is built in linear
+// light, out of floats (see convert; alpha is left as it is), and every level is encoded
+// from those, so rounding errors don't pile up from one level to the next. The output is
+// the same on every machine and for either execution policy, so mips can be cached. Both
+// layouts and views work.
+template <typename image_t>
+std::vector<typename detail::owner<image_t>::type> mip_chain(const image_t& base,
+															 resize_filter filter = resize_filter::box,
+															 encoding values = encoding::linear,
+															 execution policy = execution::sequential,
+															 size_t maxLevels = 0)
+{
+	using result_t = typename detail::owner<image_t>::type;
+	using int_t = typename result_t::int_t;
+	using linear_t = data<float, color_format(result_t::NUM_CHANNELS), int_t, result_t::LAYOUT>;
+
+	std::vector<result_t> levels;
+
+	if (base.mWidth <= 0 || base.mHeight <= 0)
+		return levels;
+
+	size_t count = 0;
+	for (int_t w = base.mWidth, h = base.mHeight; w > 1 || h > 1; ++count) {
+		w = detail::mip_extent(w);
+		h = detail::mip_extent(h);
+	}
+
+	if (maxLevels && maxLevels < count)
+		count = maxLevels;
+
+	levels.reserve(count);
+
+	if (values == encoding::linear) {
+		for (size_t i = 0; i < count; ++i) {
+			result_t level(i == 0 ? resize(base, detail::mip_extent(base.mWidth), detail::mip_extent(base.mHeight),
+										   filter, policy)
+								  : resize(levels.back(), detail::mip_extent(levels.back().mWidth),
+										   detail::mip_extent(levels.back().mHeight), filter, policy));
+			levels.push_back(std::move(level));
+		}
+
+		return levels;
+	}
+
+	linear_t linear(convert<linear_t>(base, encoding::srgb, encoding::linear, policy));
+
+	for (size_t i = 0; i < count; ++i) {
+		linear_t next(resize(linear, detail::mip_extent(linear.mWidth), detail::mip_extent(linear.mHeight), filter,
+							 policy));
+
+		levels.push_back(convert<result_t>(next, encoding::linear, encoding::srgb, policy));
+		linear = std::move(next);
+	}
+
+	return levels;
+}
+
+namespace detail {
+
+// What integral images add channels up in: 64 bit integers for 8 and 16 bit channels,
+// which keeps them exact for any image which fits in memory, and doubles for floats
+// (and halves). scale() is the channel value which stands for 1.0.
+template <typename channel_t>
+struct integral_sum
+{
+	using type = double;
+
+	static double scale(void) { return 1.0; }
+};
+
+template <>
+struct integral_sum<uint8_t>
+{
+	using type = uint64_t;
+
+	static double scale(void) { return 255.0; }
+};
+
+template <>
+struct integral_sum<uint16_t>
+{
+	using type = uint64_t;
+
+	static double scale(void) { return 65535.0; }
+};
+
+} // namespace detail
+
+// A summed area table: entry (x, y) of mSums holds, channel by channel, the sum of every
+// pixel above and to the left of pixel (x, y) of the image it was built from, so it has a
+// row and a column more than the image, and the sum over any rectangle takes four lookups
+// whatever its size. mSquares is the same for the squares of the channels, which is what
+// variances need; it's only there if integral_image was asked for it. Channels are summed
+// as they are stored (0 to 255 for 8 bit ones), see detail::integral_sum.
+template <typename Tchannel, color_format Eformat, typename Tint = int32_t>
+struct integral
+{
+	using channel_t = Tchannel;
+	using int_t = Tint;
+	using sum_t = typename detail::integral_sum<Tchannel>::type;
+
+	static const size_t NUM_CHANNELS = (size_t)Eformat;
+
+	int_t mWidth; // of the image
+	int_t mHeight;
+	size_t mStride; // in sums, between rows of the tables
+	memory::aligned_vector<sum_t> mSums;
+	memory::aligned_vector<sum_t> mSquares;
+};
+
+namespace detail {
+
+// Turns row y of an image into row y + 1 of the tables: running sums along the row,
+// which the column pass then adds up.
+template <typename image_t, typename integral_t>
+static inline void integral_rows(const image_t& src, integral_t& table, bool squares, typename image_t::int_t y0,
+								 typename image_t::int_t y1)
+{
+	using int_t = typename image_t::int_t;
+	using sum_t = typename integral_t::sum_t;
+
+	constexpr size_t channels = integral_t::NUM_CHANNELS;
+
+	for (int_t y = y0; y < y1; ++y) {
+		const typename image_t::channel_t* row = row_data(src, y);
+		sum_t* sums = &table.mSums[size_t(y + 1) * table.mStride];
+		sum_t* sq = squares ? &table.mSquares[size_t(y + 1) * table.mStride] : nullptr;
+
+		std::array<sum_t, channels> sum;
+		std::array<sum_t, channels> sumSq;
+		sum.fill(sum_t(0));
+		sumSq.fill(sum_t(0));
+
+		for (size_t c = 0; c < channels; ++c) {
+			sums[c] = sum_t(0);
+			if (sq)
+				sq[c] = sum_t(0);
+		}
+
+		for (int_t x = 0; x < src.mWidth; ++x, row += image_t::PIXEL_STRIDE) {
+			sums += channels;
+			for (size_t c = 0; c < channels; ++c) {
+				const sum_t v = sum_t(row[c]);
+				sum[c] += v;
+				sums[c] = sum[c];
+			}
+
+			if (!sq)
+				continue;
+
+			sq += channels;
+			for (size_t c = 0; c < channels; ++c) {
+				const sum_t v = sum_t(row[c]);
+				sumSq[c] += v * v;
+				sq[c] = sumSq[c];
+			}
+		}
+	}
+}
+
+// Adds every row of the tables to the one below it, for the columns [i0, i1) of sums.
+template <typename sum_t>
+static inline void integral_columns(sum_t* table, size_t stride, size_t rows, size_t i0, size_t i1)
+{
+	for (size_t y = 1; y < rows; ++y) {
+		const sum_t* above = table + (y - 1) * stride;
+		sum_t* row = table + y * stride;
+
+		for (size_t i = i0; i < i1; ++i)
+			row[i] += above[i];
+	}
+}
+
+// The sums of a table over the windows around every pixel of row y: all the pixels at
+// most radius away along both axes, clipped to the image. Returns how many rows the
+// windows span; a window's pixel count is that times its columns (see window_columns).
+template <typename integral_t>
+static inline typename integral_t::int_t window_sums(const integral_t& ii,
+													 const memory::aligned_vector<typename integral_t::sum_t>& table,
+													 typename integral_t::int_t radius, typename integral_t::int_t y,
+													 typename integral_t::sum_t* out)
+{
+	using int_t = typename integral_t::int_t;
+	using sum_t = typename integral_t::sum_t;
+
+	constexpr size_t channels = integral_t::NUM_CHANNELS;
+
+	const int_t ya = std::max(y - radius, int_t(0));
+	const int_t yb = std::min(y, ii.mHeight - 1 - radius) + radius + 1;
+	const sum_t* top = &table[size_t(ya) * ii.mStride];
+	const sum_t* bottom = &table[size_t(yb) * ii.mStride];
+
+	// Windows which lie within the image all take the same offsets, so the middle of the
+	// row is a single loop over channels, which vectorizes; the ends are clipped
+	const int_t x0 = std::min(radius, ii.mWidth);
+	const int_t x1 = std::max(x0, ii.mWidth - radius);
+	const size_t back = size_t(radius) * channels;
+	const size_t ahead = size_t(radius + 1) * channels;
+
+	for (int_t x = 0; x < ii.mWidth; ++x) {
+		if (x == x0 && x < x1) {
+			const size_t end = size_t(x1) * channels;
+			for (size_t i = size_t(x0) * channels; i < end; ++i)
+				out[i] = (bottom[i + ahead] - top[i + ahead]) - (bottom[i - back] - top[i - back]);
+			x = x1 - 1;
+			continue;
+		}
+
+		const size_t a = size_t(std::max(x - radius, int_t(0))) * channels;
+		const size_t b = size_t(std::min(x, ii.mWidth - 1 - radius) + radius + 1) * channels;
+
+		for (size_t c = 0; c < channels; ++c)
+			out[size_t(x) * channels + c] = (bottom[b + c] - top[b + c]) - (bottom[a + c] - top[a + c]);
+	}
+
+	return yb - ya;
+}
+
+template <typename int_t>
+static inline int_t window_columns(int_t width, int_t radius, int_t x)
+{
+	return std::min(x, width - 1 - radius) + radius + 1 - std::max(x - radius, int_t(0));
+}
+
+// Radii past the image's size cover it all; clamping them keeps the arithmetic in range.
+template <typename integral_t>
+static inline typename integral_t::int_t window_radius(const integral_t& ii, typename integral_t::int_t radius)
+{
+	return std::max(typename integral_t::int_t(0), std::min(radius, std::max(ii.mWidth, ii.mHeight)));
+}
+
+// A window's average, in the channel type: integer ones are rounded to nearest, as box
+// resizes round them. Dividing in doubles is exact enough for that, and much quicker
+// than a 64 bit integer divide.
+static inline uint8_t window_average(uint64_t sum, double count, uint8_t*)
+{
+	return uint8_t(double(sum) / count + 0.5);
+}
+
+static inline uint16_t window_average(uint64_t sum, double count, uint16_t*)
+{
+	return uint16_t(double(sum) / count + 0.5);
+}
+
+static inline float window_average(double sum, double count, float*)
+{
+	return float(sum / count);
+}
+
+static inline half window_average(double sum, double count, half*)
+{
+	return half(float(sum / count));
+}
+
+} // namespace detail
+
+// Builds the summed area table of an interleaved image or view. Each row is summed on its
+// own, and then the columns are, so with execution::parallel both passes are split over the
+// shared thread pool (into bands of rows, then of columns). The result is the same either
+// way. squares adds mSquares, for local_variance and box_variance.
+template <typename image_t>
+integral<typename image_t::channel_t, color_format(image_t::NUM_CHANNELS), typename image_t::int_t>
+integral_image(const image_t& src, bool squares = false, execution policy = execution::sequential)
+{
+	using result_t = integral<typename image_t::channel_t, color_format(image_t::NUM_CHANNELS), typename image_t::int_t>;
+	using int_t = typename image_t::int_t;
+	using sum_t = typename result_t::sum_t;
+
+	result_t ii;
+	ii.mWidth = std::max(src.mWidth, int_t(0));
+	ii.mHeight = std::max(src.mHeight, int_t(0));
+	ii.mStride = (size_t(ii.mWidth) + 1) * result_t::NUM_CHANNELS;
+
+	const size_t rows = size_t(ii.mHeight) + 1;
+	ii.mSums.assign(rows * ii.mStride, sum_t(0));
+	if (squares)
+		ii.mSquares.assign(rows * ii.mStride, sum_t(0));
+
+	for_each_band(ii.mHeight, policy, [&](int_t y0, int_t y1) {
+		detail::integral_rows(src, ii, squares, y0, y1);
+	});
+
+	for_each_band(int_t(ii.mStride), policy, [&](int_t i0, int_t i1) {
+		detail::integral_columns(&ii.mSums[0], ii.mStride, rows, size_t(i0), size_t(i1));
+		if (squares)
+			detail::integral_columns(&ii.mSquares[0], ii.mStride, rows, size_t(i0), size_t(i1));
+	}, int_t(64));
+
+	return ii;
+}
+
+// The sums of the channels over the pixels in [x0, x1) x [y0, y1), clipped to the image.
+// Four lookups per channel, whatever the rectangle's size.
+template <typename Tchannel, color_format Eformat, typename Tint>
+std::array<typename integral<Tchannel, Eformat, Tint>::sum_t, (size_t)Eformat>
+box_sum(const integral<Tchannel, Eformat, Tint>& ii, Tint x0, Tint y0, Tint x1, Tint y1)
+{
+	using sum_t = typename integral<Tchannel, Eformat, Tint>::sum_t;
+
+	std::array<sum_t, (size_t)Eformat> sum;
+	sum.fill(sum_t(0));
+
+	x0 = std::max(x0, Tint(0));
+	y0 = std::max(y0, Tint(0));
+	x1 = std::min(x1, ii.mWidth);
+	y1 = std::min(y1, ii.mHeight);
+
+	if (x0 >= x1 || y0 >= y1)
+		return sum;
+
+	const sum_t* top = &ii.mSums[size_t(y0) * ii.mStride];
+	const sum_t* bottom = &ii.mSums[size_t(y1) * ii.mStride];
+	const size_t a = size_t(x0) * (size_t)Eformat;
+	const size_t b = size_t(x1) * (size_t)Eformat;
+
+	for (size_t c = 0; c < (size_t)Eformat; ++c)
+		sum[c] = (bottom[b + c] - top[b + c]) - (bottom[a + c] - top[a + c]);
+
+	return sum;
+}
+
+// The mean of the channels over a rectangle (clipped as box_sum clips it), normalized
+// like load_channels normalizes them. An empty rectangle's mean is 0.
+template <typename Tchannel, color_format Eformat, typename Tint>
+std::array<float, (size_t)Eformat> box_mean(const integral<Tchannel, Eformat, Tint>& ii, Tint x0, Tint y0, Tint x1,
+											Tint y1)
+{
+	std::array<float, (size_t)Eformat> mean;
+	mean.fill(0.0f);
+
+	const auto sum(box_sum(ii, x0, y0, x1, y1));
+	const double count = double(std::max(std::min(x1, ii.mWidth) - std::max(x0, Tint(0)), Tint(0))) *
+						 double(std::max(std::min(y1, ii.mHeight) - std::max(y0, Tint(0)), Tint(0)));
+
+	if (count > 0.0) {
+		for (size_t c = 0; c < (size_t)Eformat; ++c)
+			mean[c] = float(double(sum[c]) / (count * detail::integral_sum<Tchannel>::scale()));
+	}
+
+	return mean;
+}
+
+// The (population) variance of the channels over a rectangle, normalized like box_mean.
+// Needs the table's squares; without them, or for an empty rectangle, it's 0. It comes
+// from the mean of the squares less the square of the mean, which for floats loses
+// digits when the variance is tiny next to the mean, so it's clamped at 0.
+template <typename Tchannel, color_format Eformat, typename Tint>
+std::array<float, (size_t)Eformat> box_variance(const integral<Tchannel, Eformat, Tint>& ii, Tint x0, Tint y0,
+												Tint x1, Tint y1)
+{
+	using sum_t = typename integral<Tchannel, Eformat, Tint>::sum_t;
+
+	std::array<float, (size_t)Eformat> variance;
+	variance.fill(0.0f);
+
+	x0 = std::max(x0, Tint(0));
+	y0 = std::max(y0, Tint(0));
+	x1 = std::min(x1, ii.mWidth);
+	y1 = std::min(y1, ii.mHeight);
+
+	if (ii.mSquares.empty() || x0 >= x1 || y0 >= y1)
+		return variance;
+
+	const double count = double(x1 - x0) * double(y1 - y0);
+	const double scale = detail::integral_sum<Tchannel>::scale();
+	const auto sum(box_sum(ii, x0, y0, x1, y1));
+
+	const sum_t* top = &ii.mSquares[size_t(y0) * ii.mStride];
+	const sum_t* bottom = &ii.mSquares[size_t(y1) * ii.mStride];
+	const size_t a = size_t(x0) * (size_t)Eformat;
+	const size_t b = size_t(x1) * (size_t)Eformat;
+
+	for (size_t c = 0; c < (size_t)Eformat; ++c) {
+		const double mean = double(sum[c]) / count;
+		const double squares = double((bottom[b + c] - top[b + c]) - (bottom[a + c] - top[a + c])) / count;
+		variance[c] = float(std::max(squares - mean * mean, 0.0) / (scale * scale));
+	}
+
+	return variance;
+}
+
+// Box filters the image a table was built from: every pixel becomes the average of the
+// (2 * radius + 1)^2 pixels around it. Near the edges the window is clipped to the image
+// and the average is over what's left of it, instead of making up pixels past the edge
+// like apply_kernel's borders do. Each pixel costs the same whatever the radius, so
+// this is the way to do wide boxes; apply_kernel(kernel_box<N>) is fine for narrow ones.
+template <typename Tchannel, color_format Eformat, typename Tint>
+data<Tchannel, Eformat, Tint> box_filter(const integral<Tchannel, Eformat, Tint>& ii, Tint radius,
+										 execution policy = execution::sequential)
+{
+	using result_t = data<Tchannel, Eformat, Tint>;
+	using sum_t = typename integral<Tchannel, Eformat, Tint>::sum_t;
+
+	result_t dst(make_image<result_t>(ii.mWidth, ii.mHeight, typename result_t::pixel_t()));
+	radius = detail::window_radius(ii, radius);
+
+	for_each_band(dst.mHeight, policy, [&](Tint y0, Tint y1) {
+		memory::aligned_vector<sum_t> sums(size_t(dst.mWidth) * (size_t)Eformat);
+
+		for (Tint y = y0; y < y1; ++y) {
+			const double rows = double(detail::window_sums(ii, ii.mSums, radius, y, &sums[0]));
+			Tchannel* out = detail::row_data(dst, y);
+
+			for (Tint x = 0; x < dst.mWidth; ++x, out += (size_t)Eformat) {
+				const double count = rows * double(detail::window_columns(dst.mWidth, radius, x));
+				for (size_t c = 0; c < (size_t)Eformat; ++c)
+					out[c] = detail::window_average(sums[size_t(x) * (size_t)Eformat + c], count, out);
+			}
+		}
+	});
+
+	return dst;
+}
+
+template <typename image_t>
+typename detail::owner<image_t>::type box_filter(const image_t& src, typename image_t::int_t radius,
+												 execution policy = execution::sequential)
+{
+	return box_filter(integral_image(src, false, policy), radius, policy);
+}
+
+// The mean of the window around every pixel (clipped like box_filter's), normalized: a
+// float image whatever the channels were, so nothing is lost to rounding.
+template <typename Tchannel, color_format Eformat, typename Tint>
+data<float, Eformat, Tint> local_mean(const integral<Tchannel, Eformat, Tint>& ii, Tint radius,
+									  execution policy = execution::sequential)
+{
+	using result_t = data<float, Eformat, Tint>;
+	using sum_t = typename integral<Tchannel, Eformat, Tint>::sum_t;
+
+	result_t dst(make_image<result_t>(ii.mWidth, ii.mHeight, typename result_t::pixel_t()));
+	radius = detail::window_radius(ii, radius);
+
+	const double scale = detail::integral_sum<Tchannel>::scale();
+
+	for_each_band(dst.mHeight, policy, [&](Tint y0, Tint y1) {
+		memory::aligned_vector<sum_t> sums(size_t(dst.mWidth) * (size_t)Eformat);
+
+		for (Tint y = y0; y < y1; ++y) {
+			const double rows = double(detail::window_sums(ii, ii.mSums, radius, y, &sums[0]));
+			float* out = detail::row_data(dst, y);
+
+			for (Tint x = 0; x < dst.mWidth; ++x, out += (size_t)Eformat) {
+				const double count = rows * double(detail::window_columns(dst.mWidth, radius, x)) * scale;
+				for (size_t c = 0; c < (size_t)Eformat; ++c)
+					out[c] = float(double(sums[size_t(x) * (size_t)Eformat + c]) / count);
+			}
+		}
+	});
+
+	return dst;
+}
+
+template <typename image_t>
+data<float, color_format(image_t::NUM_CHANNELS), typename image_t::int_t>
+local_mean(const image_t& src, typename image_t::int_t radius, execution policy = execution::sequential)
+{
+	return local_mean(integral_image(src, false, policy), radius, policy);
+}
+
+// The variance of the window around every pixel, normalized like local_mean, and with
+// box_variance's caveats; a table without squares gives zeros. Together with local_mean
+// this is what adaptive thresholds and guided filters are made of.
+template <typename Tchannel, color_format Eformat, typename Tint>
+data<float, Eformat, Tint> local_variance(const integral<Tchannel, Eformat, Tint>& ii, Tint radius,
+										  execution policy = execution::sequential)
+{
+	using result_t = data<float, Eformat, Tint>;
+	using sum_t = typename integral<Tchannel, Eformat, Tint>::sum_t;
+
+	result_t dst(make_image<result_t>(ii.mWidth, ii.mHeight, typename result_t::pixel_t()));
+	if (ii.mSquares.empty())
+		return dst;
+
+	radius = detail::window_radius(ii, radius);
+
+	const double scale = detail::integral_sum<Tchannel>::scale();
+
+	for_each_band(dst.mHeight, policy, [&](Tint y0, Tint y1) {
+		const size_t count = size_t(dst.mWidth) * (size_t)Eformat;
+		memory::aligned_vector<sum_t> sums(count);
+		memory::aligned_vector<sum_t> squares(count);
+
+		for (Tint y = y0; y < y1; ++y) {
+			const double rows = double(detail::window_sums(ii, ii.mSums, radius, y, &sums[0]));
+			detail::window_sums(ii, ii.mSquares, radius, y, &squares[0]);
+			float* out = detail::row_data(dst, y);
+
+			for (Tint x = 0; x < dst.mWidth; ++x, out += (size_t)Eformat) {
+				const double n = rows * double(detail::window_columns(dst.mWidth, radius, x));
+				for (size_t c = 0; c < (size_t)Eformat; ++c) {
+					const size_t i = size_t(x) * (size_t)Eformat + c;
+					const double mean = double(sums[i]) / n;
+					out[c] = float(std::max(double(squares[i]) / n - mean * mean, 0.0) / (scale * scale));
+				}
+			}
+		}
+	});
+
+	return dst;
+}
+
+template <typename image_t>
+data<float, color_format(image_t::NUM_CHANNELS), typename image_t::int_t>
+local_variance(const image_t& src, typename image_t::int_t radius, execution policy = execution::sequential)
+{
+	return local_variance(integral_image(src, true, policy), radius, policy);
+}
+
+// An image which lives in a raw file (see img/raw_file.h) rather than in memory, so that it
+// can be far bigger than memory is. Its pixels are read and written a region at a time
+// through a raw::tile_cache, which keeps recently used tiles in memory within a budget
+// and writes changed ones back. make_tiled creates one and open_tiled opens a file made
+// by write_raw (or an earlier make_tiled); process_tiles runs operations over them.
+// The file is complete once flush (or the cache's destructor) has written everything back.
+template <typename Tchannel, color_format Eformat, typename Tint = int32_t>
+struct tiled
+{
+	using channel_t = Tchannel;
+	using int_t = Tint;
+	using pixel_t = pixel<Tchannel, Eformat, Tint>;
+
+	static const size_t NUM_CHANNELS = (size_t)Eformat;
+	static const size_t PIXEL_STRIDE = (size_t)Eformat;
+	static const size_t PIXEL_STRIDE_BYTES = PIXEL_STRIDE * sizeof(Tchannel);
+
+	int_t mWidth = 0;
+	int_t mHeight = 0;
+	std::unique_ptr<raw::tile_cache> mCache; // null unless a file is open
+};
+
+// Creates path, as a width x height image_t with every pixel zero, in the form of a
+// tiled image. budget is how many bytes of tiles may be in memory at once. If the file
+// can't be created, the result has no mCache.
+template <typename image_t>
+tiled<typename image_t::channel_t, color_format(image_t::NUM_CHANNELS), typename image_t::int_t>
+make_tiled(const std::string &path, typename image_t::int_t width, typename image_t::int_t height,
+		   size_t budget = raw::tile_cache::DEFAULT_BUDGET, uint32_t tileSize = raw::tile_cache::DEFAULT_TILE_SIZE)
+{
+	using channel_t = typename image_t::channel_t;
+
+	tiled<channel_t, color_format(image_t::NUM_CHANNELS), typename image_t::int_t> result;
+
+	raw::header h = raw::header();
+	h.mWidth = uint32_t(glm::max(width, typename image_t::int_t(0)));
+	h.mHeight = uint32_t(glm::max(height, typename image_t::int_t(0)));
+	h.mChannels = uint32_t(image_t::NUM_CHANNELS);
+	h.mChannelType = uint32_t(detail::raw_channel_type((const channel_t*) nullptr));
+
+	std::unique_ptr<raw::tile_cache> cache(new raw::tile_cache());
+	if (cache->create(path.c_str(), h, tileSize, budget)) {
+		result.mWidth = width;
+		result.mHeight = height;
+		result.mCache = std::move(cache);
+	}
+
+	return result;
+}
+
+// Opens a raw file as a tiled image. Errors are as for map_file; only writable
+// images can be written to.
+template <typename image_t>
+tiled<typename image_t::channel_t, color_format(image_t::NUM_CHANNELS), typename image_t::int_t>
+open_tiled(const std::string &path, from_file_error *error, bool writable = false,
+		   size_t budget = raw::tile_cache::DEFAULT_BUDGET, uint32_t tileSize = raw::tile_cache::DEFAULT_TILE_SIZE)
+{
+	using channel_t = typename image_t::channel_t;
+	using int_t = typename image_t::int_t;
+
+	tiled<channel_t, color_format(image_t::NUM_CHANNELS), int_t> result;
+	from_file_error e = from_file_error::none;
+
+	const uint64_t largest = uint64_t(std::numeric_limits<int_t>::max());
+	std::unique_ptr<raw::tile_cache> cache(new raw::tile_cache());
+
+	if (!cache->open(path.c_str(), writable, tileSize, budget)) {
+		FILE* file = fopen(path.c_str(), "rb");
+		e = file ? from_file_error::invalid_file : from_file_error::invalid_path;
+		if (file)
+			fclose(file);
+	} else {
+		const raw::header& h = cache->info();
+		if (h.mChannels != image_t::NUM_CHANNELS ||
+			h.mChannelType != uint32_t(detail::raw_channel_type((const channel_t*) nullptr)) ||
+			h.mWidth > largest || h.mHeight > largest) {
+			e = from_file_error::incompatible_format;
+		} else {
+			result.mWidth = int_t(h.mWidth);
+			result.mHeight = int_t(h.mHeight);
+			result.mCache = std::move(cache);
+		}
+	}
+
+	if (error)
+		*error = e;
+
+	return result;
+}
+
+// Copies the dst.mWidth x dst.mHeight rectangle of src at (x, y) into dst, which has
+// to lie within src. Returns false if it doesn't, or if the file can't be read.
+template <typename Tchannel, color_format Eformat, typename Tint>
+bool read_region(const tiled<Tchannel, Eformat, Tint> &src, Tint x, Tint y, const IMG_VIEW_TMPL &dst)
+{
+	if (!src.mCache || x < 0 || y < 0 || dst.mWidth < 0 || dst.mHeight < 0)
+		return false;
+
+	if (dst.mWidth == 0 || dst.mHeight == 0)
+		return true;
+
+	return src.mCache->read(uint32_t(x), uint32_t(y), uint32_t(dst.mWidth), uint32_t(dst.mHeight),
+							detail::row_data(dst, Tint(0)), ptrdiff_t(dst.mStride) * IMG_VIEW_TMPL::PIXEL_STRIDE_BYTES);
+}
+
+// The same, into an image of its own; the rectangle is clipped to src.
+template <typename Tchannel, color_format Eformat, typename Tint>
+IMG_DATA_TMPL read_region(const tiled<Tchannel, Eformat, Tint> &src, Tint x, Tint y, Tint width, Tint height)
+{
+	const Tint x0 = glm::clamp(x, Tint(0), src.mWidth);
+	const Tint y0 = glm::clamp(y, Tint(0), src.mHeight);
+	const Tint x1 = glm::clamp(x + width, x0, src.mWidth);
+	const Tint y1 = glm::clamp(y + height, y0, src.mHeight);
+
+	IMG_DATA_TMPL region(make_image<IMG_DATA_TMPL>(x1 - x0, y1 - y0, IMG_PIXEL_TMPL()));
+	read_region(src, x0, y0, make_view(region));
+
+	return region;
+}
+
+// Writes src (an image or a view, of dst's type) into dst with its top left corner at
+// (x, y); all of it has to land within dst.
+template <typename Tchannel, color_format Eformat, typename Tint, typename image_t>
+bool write_region(tiled<Tchannel, Eformat, Tint> &dst, Tint x, Tint y, const image_t &src)
+{
+	const view<const Tchannel, Eformat, Tint> source(make_view(src));
+
+	if (!dst.mCache || x < 0 || y < 0 || source.mWidth < 0 || source.mHeight < 0)
+		return false;
+
+	if (source.mWidth == 0 || source.mHeight == 0)
+		return true;
+
+	return dst.mCache->write(uint32_t(x), uint32_t(y), uint32_t(source.mWidth), uint32_t(source.mHeight),
+							 detail::row_data(source, Tint(0)),
+							 ptrdiff_t(source.mStride) * ptrdiff_t(tiled<Tchannel, Eformat, Tint>::PIXEL_STRIDE_BYTES));
+}
+
+// Writes every changed tile back to the file.
+template <typename Tchannel, color_format Eformat, typename Tint>
+bool flush(tiled<Tchannel, Eformat, Tint> &image)
+{
+	return image.mCache && image.mCache->flush();
+}
+
+namespace detail {
+
+// The w x h rectangle of src at (x, y), as something operations take: images and views
+// are looked at where they are, and tiled images are read into storage.
+template <typename image_t, typename storage_t, typename int_t>
+static inline auto source_region(const image_t& src, int_t x, int_t y, int_t w, int_t h, storage_t&)
+	-> decltype(make_view(src, x, y, w, h))
+{
+	return make_view(src, x, y, w, h);
+}
+
+template <typename Tchannel, color_format Eformat, typename Tint>
+static inline view<const Tchannel, Eformat, Tint> source_region(const tiled<Tchannel, Eformat, Tint>& src, Tint x,
+																Tint y, Tint w, Tint h, IMG_DATA_TMPL& storage)
+{
+	storage = read_region(src, x, y, w, h);
+	return make_view(static_cast<const IMG_DATA_TMPL&>(storage));
+}
+
+// And the other way: puts region into dst, with its top left corner at (x, y).
+template <typename Tchannel, color_format Eformat, typename Tint, typename region_t>
+static inline bool store_region(const IMG_VIEW_TMPL& dst, Tint x, Tint y, const region_t& region)
+{
+	static_assert(std::is_same<typename region_t::channel_t, typename IMG_VIEW_TMPL::channel_t>::value &&
+				  region_t::NUM_CHANNELS == IMG_VIEW_TMPL::NUM_CHANNELS, "results have to be of dst's type");
+
+	const IMG_VIEW_TMPL target(make_view(dst, x, y, region.mWidth, region.mHeight));
+	const size_t rowBytes = size_t(region.mWidth) * IMG_VIEW_TMPL::PIXEL_STRIDE_BYTES;
+
+	for (Tint r = 0; r < region.mHeight; ++r)
+		memcpy(row_data(target, r), row_data(region, r), rowBytes);
+
+	return true;
+}
+
+template <typename Tchannel, color_format Eformat, typename Tint, typename region_t>
+static inline bool store_region(IMG_DATA_TMPL& dst, Tint x, Tint y, const region_t& region)
+{
+	return store_region(make_view(dst), x, y, region);
+}
+
+template <typename Tchannel, color_format Eformat, typename Tint, typename region_t>
+static inline bool store_region(tiled<Tchannel, Eformat, Tint>& dst, Tint x, Tint y, const region_t& region)
+{
+	return write_region(dst, x, y, region);
+}
+
+// How a dst side relates to the src side it's made from: dst = src * up / down, where
+// one of the two is 1. Sizes which aren't whole multiples of each other can't be tiled.
+template <typename int_t>
+static inline bool tile_ratio(int_t src, int_t dst, int_t* up, int_t* down)
+{
+	*up = *down = 1;
+
+	if (src <= 0 || dst <= 0)
+		return src == dst;
+
+	if (dst >= src && dst % src == 0)
+		*up = dst / src;
+	else if (src > dst && src % dst == 0)
+		*down = src / dst;
+	else
+		return false;
+
+	return true;
+}
+
+} // namespace detail
+
+// Runs fn over src a tile at a time and stores the results in dst, e.g.
+// process_tiles(src, dst, [](const auto& region) { return apply_kernel(region, k); }, N / 2).
+// fn gets a view of the src pixels a tile of dst is made from, plus halo pixels on every
+// side (what fn reads around a pixel: a kernel's radius, a resize filter's support), and
+// returns an image of that region's size scaled by dst's size over src's; each side of dst
+// has to be a whole multiple or fraction of src's. With execution::parallel, fn is called
+// from several threads at once. Returns false if the sizes don't work out, fn returns an
+// image of the wrong size, or a tiled image fails to be read or written.
+template <typename src_t, typename dst_t, typename fn_t>
+bool process_tiles(const src_t &src, dst_t &&dst, fn_t fn, int32_t halo = 0,
+				   execution policy = execution::sequential, int32_t tileSize = 512)
+{
+	using int_t = typename std::decay<dst_t>::type::int_t;
+	using storage_t = data<typename src_t::channel_t, color_format(src_t::NUM_CHANNELS), typename src_t::int_t>;
+
+	int_t upX, downX, upY, downY;
+	if (!detail::tile_ratio<int_t>(src.mWidth, dst.mWidth, &upX, &downX) ||
+		!detail::tile_ratio<int_t>(src.mHeight, dst.mHeight, &upY, &downY) || halo < 0 || tileSize <= 0)
+		return false;
+
+	if (dst.mWidth <= 0 || dst.mHeight <= 0)
+		return true;
+
+	// Tiles start on whole source pixels, and halos end on whole destination ones
+	const int_t tileW = (int_t(tileSize) + upX - 1) / upX * upX;
+	const int_t tileH = (int_t(tileSize) + upY - 1) / upY * upY;
+	const int_t haloX = (int_t(halo) + downX - 1) / downX * downX;
+	const int_t haloY = (int_t(halo) + downY - 1) / downY * downY;
+
+	const size_t columns = size_t((dst.mWidth + tileW - 1) / tileW);
+	const size_t count = columns * size_t((dst.mHeight + tileH - 1) / tileH);
+
+	thread_pool& pool = thread_pool::shared();
+	const size_t lanes = policy == execution::parallel ? std::min(pool.concurrency(), count) : 1;
+
+	std::atomic<size_t> next(0);
+	std::atomic<bool> failed(false);
+
+	pool.parallel_for(lanes, [&](size_t) {
+		storage_t storage;
+
+		for (size_t i = next++; i < count && !failed; i = next++) {
+			const int_t x = int_t(i % columns) * tileW;
+			const int_t y = int_t(i / columns) * tileH;
+			const int_t w = glm::min(tileW, dst.mWidth - x);
+			const int_t h = glm::min(tileH, dst.mHeight - y);
+
+			const int_t sx0 = glm::max(x / upX * downX - haloX, int_t(0));
+			const int_t sy0 = glm::max(y / upY * downY - haloY, int_t(0));
+			const int_t sx1 = glm::min((x + w + upX - 1) / upX * downX + haloX, int_t(src.mWidth));
+			const int_t sy1 = glm::min((y + h + upY - 1) / upY * downY + haloY, int_t(src.mHeight));
+
+			const auto result = fn(detail::source_region(src, sx0, sy0, sx1 - sx0, sy1 - sy0, storage));
+			const auto region = make_view(result);
+
+			if (region.mWidth != (sx1 - sx0) * upX / downX || region.mHeight != (sy1 - sy0) * upY / downY ||
+				!detail::store_region(dst, x, y, make_view(region, x - sx0 * upX / downX, y - sy0 * upY / downY, w, h)))
+				failed = true;
+		}
+	});
+
+	return !failed;
+}
+
+// Debugging...
+IMG_LAYOUT_DEF std::string to_string(const IMG_LAYOUT_TMPL &image)
+{
+	std::stringstream stream;
+	for (IMG_INT_TYPE y = 0; y < image.mHeight; ++y) {
+		for (IMG_INT_TYPE x = 0; x < image.mWidth; ++x) {
+			stream << to_string(get_pixel(image, x, y));
+			if ((x + 1) != image.mWidth)
+				stream << ", ";
+		}
+		stream << '\n';
+	}
+	return stream.str();
+}
+
+IMG_DEF std::string to_string(const IMG_VIEW_TMPL &image)
+{
+	return to_string(make_image(image));
 }
 
 // Debugging...
@@ -353,11 +4716,25 @@ using rgb_f32_t = data<float, color_format::rgb>;
 using rgb_u8_t = data<uint8_t, color_format::rgb>;
 using greyscale_u8_t = data<uint8_t, color_format::greyscale>;
 using greyscale_f32_t = data<float, color_format::greyscale>;
+using rgb_planar_f32_t = data<float, color_format::rgb, int32_t, layout::planar>;
+using rgb_planar_u8_t = data<uint8_t, color_format::rgb, int32_t, layout::planar>;
+using rgba_u8_t = data<uint8_t, color_format::rgba>;
+using rgba_f32_t = data<float, color_format::rgba>;
+using rgb_u16_t = data<uint16_t, color_format::rgb>;
+using rgba_u16_t = data<uint16_t, color_format::rgba>;
+using greyscale_u16_t = data<uint16_t, color_format::greyscale>;
+using rgb_f16_t = data<half, color_format::rgb>;
+using rgba_f16_t = data<half, color_format::rgba>;
+using greyscale_f16_t = data<half, color_format::greyscale>;
 
 } // namespace img
 
 #undef IMG_DEF
 #undef IMG_DATA_TMPL
+#undef IMG_PLANAR_TMPL
+#undef IMG_LAYOUT_DEF
+#undef IMG_LAYOUT_TMPL
+#undef IMG_VIEW_TMPL
 #undef IMG_INT_TYPE
 #undef IMG_PIXEL_TMPL
 #undef IMG_MAKE_KERNEL
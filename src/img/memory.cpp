@@ -0,0 +1,83 @@
+#include "memory.h"
+
+#include <stdlib.h>
+#include <atomic>
+
+#if defined(_MSC_VER)
+#	include <malloc.h>
+#elif defined(__linux__) && !defined(EMSCRIPTEN)
+#	include <sys/mman.h>
+#endif
+
+namespace img {
+namespace memory {
+
+namespace {
+
+std::atomic<bool> gHugePageHints(false);
+
+void* aligned_malloc(size_t alignment, size_t bytes)
+{
+#if defined(_MSC_VER)
+	return _aligned_malloc(bytes, alignment);
+#else
+	void* p = nullptr;
+	return posix_memalign(&p, alignment, bytes) == 0 ? p : nullptr;
+#endif
+}
+
+void advise_huge_pages(void* p, size_t bytes)
+{
+#if defined(__linux__) && !defined(EMSCRIPTEN) && defined(MADV_HUGEPAGE)
+	// Purely a hint: if THP is disabled this fails, and that's fine
+	madvise(p, bytes, MADV_HUGEPAGE);
+#else
+	(void)p;
+	(void)bytes;
+#endif
+}
+
+} // namespace
+
+void set_huge_page_hints(bool enabled)
+{
+	gHugePageHints.store(enabled);
+}
+
+bool huge_page_hints(void)
+{
+	return gHugePageHints.load();
+}
+
+void* allocate(size_t bytes)
+{
+	if (bytes == 0)
+		bytes = 1;
+
+	const bool huge = bytes >= HUGE_PAGE_SIZE && huge_page_hints();
+
+	// madvise works on whole pages, so a hinted buffer is padded out to one
+	if (huge)
+		bytes = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+	void* p = aligned_malloc(huge ? HUGE_PAGE_SIZE : ROW_ALIGNMENT, bytes);
+	if (!p)
+		throw std::bad_alloc();
+
+	if (huge)
+		advise_huge_pages(p, bytes);
+
+	return p;
+}
+
+void release(void* p)
+{
+#if defined(_MSC_VER)
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+} // namespace memory
+} // namespace img
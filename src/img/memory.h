@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <new>
+#include <vector>
+
+// Storage for pixel buffers. Everything img allocates starts on a 64 byte
+// boundary, which together with rows padded to a multiple of 64 bytes (see
+// data::mStride) means that every row starts on a cache line, and the vector
+// loads at the beginning of a row are aligned.
+
+namespace img {
+namespace memory {
+
+static const size_t ROW_ALIGNMENT = 64;
+
+// Buffers at least this large are aligned to it and, when huge page hints
+// are on, advised to the kernel as transparent huge page candidates.
+static const size_t HUGE_PAGE_SIZE = size_t(2) << 20;
+
+// Off by default. Huge pages cut TLB misses on large images, at the cost of
+// memory for buffers which are just over a multiple of HUGE_PAGE_SIZE.
+// Only does anything on Linux.
+void set_huge_page_hints(bool enabled);
+
+bool huge_page_hints(void);
+
+// Throws std::bad_alloc on failure, like operator new.
+void* allocate(size_t bytes);
+
+void release(void* p);
+
+template <typename T>
+struct aligned_allocator
+{
+	using value_type = T;
+
+	aligned_allocator(void) {}
+
+	template <typename U>
+	aligned_allocator(const aligned_allocator<U>&) {}
+
+	T* allocate(size_t n)
+	{
+		return static_cast<T*>(memory::allocate(n * sizeof(T)));
+	}
+
+	void deallocate(T* p, size_t)
+	{
+		memory::release(p);
+	}
+};
+
+template <typename T, typename U>
+bool operator==(const aligned_allocator<T>&, const aligned_allocator<U>&)
+{
+	return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const aligned_allocator<T>&, const aligned_allocator<U>&)
+{
+	return false;
+}
+
+template <typename T>
+using aligned_vector = std::vector<T, aligned_allocator<T>>;
+
+} // namespace memory
+} // namespace img
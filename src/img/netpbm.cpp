@@ -0,0 +1,425 @@
+#include "netpbm.h"
+#include "simd.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <utility>
+
+namespace img {
+namespace netpbm {
+
+namespace {
+
+bool host_is_little_endian(void)
+{
+	const uint16_t probe = 1;
+	uint8_t first;
+	memcpy(&first, &probe, 1);
+	return first == 1;
+}
+
+// Files can be far bigger than a long reaches
+bool seek(FILE* file, int64_t offset)
+{
+#if defined(_MSC_VER)
+	return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+	return fseeko(file, off_t(offset), SEEK_SET) == 0;
+#endif
+}
+
+int64_t tell(FILE* file)
+{
+#if defined(_MSC_VER)
+	return _ftelli64(file);
+#else
+	return int64_t(ftello(file));
+#endif
+}
+
+// The next whitespace separated token of a header, skipping comments. The whitespace
+// which ends it is consumed too, which for the last one is the single character
+// between the header and the data.
+bool read_token(FILE* file, std::string& token)
+{
+	token.clear();
+
+	int c = fgetc(file);
+	for (;;) {
+		if (c == '#') {
+			while (c != EOF && c != '\n' && c != '\r')
+				c = fgetc(file);
+		} else if (c != EOF && isspace(c)) {
+			c = fgetc(file);
+		} else {
+			break;
+		}
+	}
+
+	while (c != EOF && !isspace(c)) {
+		token.push_back(char(c));
+		c = fgetc(file);
+	}
+
+	return !token.empty() && c != EOF;
+}
+
+bool read_number(FILE* file, uint32_t lowest, uint32_t highest, uint32_t* value)
+{
+	std::string token;
+	if (!read_token(file, token))
+		return false;
+
+	char* end = nullptr;
+	unsigned long v = strtoul(token.c_str(), &end, 10);
+	if (*end != '\0' || !isdigit((unsigned char) token[0]) || v < lowest || v > highest)
+		return false;
+
+	*value = uint32_t(v);
+	return true;
+}
+
+size_t sample_bytes(sample_type samples)
+{
+	return samples == sample_type::u8 ? 1 : (samples == sample_type::u16 ? 2 : 4);
+}
+
+void swap_floats(uint8_t* bytes, size_t count)
+{
+	for (size_t i = 0; i < count; ++i) {
+		uint8_t* f = bytes + i * 4;
+		std::swap(f[0], f[3]);
+		std::swap(f[1], f[2]);
+	}
+}
+
+} // namespace
+
+reader::reader(void)
+	: mFile(nullptr),
+	  mWidth(0),
+	  mHeight(0),
+	  mChannels(0),
+	  mMaxValue(0),
+	  mSamples(sample_type::u8),
+	  mSwapBytes(false),
+	  mNextRow(0),
+	  mDataStart(0)
+{}
+
+reader::~reader(void)
+{
+	close();
+}
+
+void reader::close(void)
+{
+	if (mFile)
+		fclose(mFile);
+
+	mFile = nullptr;
+	mWidth = mHeight = mChannels = mMaxValue = mNextRow = 0;
+}
+
+bool reader::open(const char* path)
+{
+	close();
+
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	char magic[2];
+	bool ok = fread(magic, 1, 2, file) == 2 && magic[0] == 'P';
+	bool pfm = false;
+
+	if (ok) {
+		switch (magic[1]) {
+		case '5': mChannels = 1; break;
+		case '6': mChannels = 3; break;
+		case 'f': mChannels = 1; pfm = true; break;
+		case 'F': mChannels = 3; pfm = true; break;
+		default: ok = false; break;
+		}
+	}
+
+	// The limit keeps a row's size in range of everything which works it out
+	const uint32_t LARGEST = (uint32_t(1) << 30) - 1;
+	ok = ok && read_number(file, 1, LARGEST, &mWidth) && read_number(file, 1, LARGEST, &mHeight);
+
+	if (ok && pfm) {
+		// The scale's sign is the byte order; its magnitude means nothing to us
+		std::string token;
+		char* end = nullptr;
+		ok = read_token(file, token);
+
+		const double scale = ok ? strtod(token.c_str(), &end) : 0.0;
+		ok = ok && *end == '\0' && scale != 0.0;
+
+		mMaxValue = 0;
+		mSamples = sample_type::f32;
+		mSwapBytes = (scale < 0.0) != host_is_little_endian();
+	} else if (ok) {
+		ok = read_number(file, 1, 65535, &mMaxValue);
+		mSamples = mMaxValue < 256 ? sample_type::u8 : sample_type::u16;
+		mSwapBytes = false;
+	}
+
+	mDataStart = ok ? tell(file) : -1;
+
+	if (!ok || mDataStart < 0) {
+		fclose(file);
+		close();
+		return false;
+	}
+
+	const size_t count = size_t(mWidth) * mChannels;
+	mRow.resize(count * sample_bytes(mSamples));
+	mValues.resize(count);
+
+	mFile = file;
+	mNextRow = 0;
+	return true;
+}
+
+bool reader::read_file_row(void)
+{
+	if (!mFile || mNextRow >= mHeight)
+		return false;
+
+	if (mSamples == sample_type::f32 && !seek(mFile, mDataStart + int64_t(mHeight - 1 - mNextRow) * int64_t(mRow.size())))
+		return false;
+
+	if (fread(&mRow[0], 1, mRow.size(), mFile) != mRow.size())
+		return false;
+
+	++mNextRow;
+	return true;
+}
+
+// Reads the next row into mValues, normalized.
+bool reader::read_values(void)
+{
+	if (!read_file_row())
+		return false;
+
+	const size_t count = mValues.size();
+	float* dst = &mValues[0];
+
+	switch (mSamples) {
+	case sample_type::u8:
+		if (mMaxValue == 255) {
+			simd::kernels().mLoadU8(&mRow[0], dst, count);
+		} else {
+			for (size_t i = 0; i < count; ++i)
+				dst[i] = float(mRow[i]) / float(mMaxValue);
+		}
+		break;
+
+	case sample_type::u16:
+		for (size_t i = 0; i < count; ++i)
+			dst[i] = float((uint32_t(mRow[2 * i]) << 8) | mRow[2 * i + 1]) / float(mMaxValue);
+		break;
+
+	case sample_type::f32:
+		if (mSwapBytes)
+			swap_floats(&mRow[0], count);
+		memcpy(dst, &mRow[0], count * sizeof(float));
+		break;
+	}
+
+	return true;
+}
+
+bool reader::read_row(uint8_t* dst)
+{
+	if (mSamples == sample_type::u8 && mMaxValue == 255) {
+		if (!read_file_row())
+			return false;
+
+		memcpy(dst, &mRow[0], mRow.size());
+		return true;
+	}
+
+	if (!read_values())
+		return false;
+
+	simd::kernels().mStoreU8(&mValues[0], dst, mValues.size());
+	return true;
+}
+
+bool reader::read_row(uint16_t* dst)
+{
+	if (mSamples == sample_type::u16 && mMaxValue == 65535) {
+		if (!read_file_row())
+			return false;
+
+		for (size_t i = 0; i < mValues.size(); ++i)
+			dst[i] = uint16_t((uint32_t(mRow[2 * i]) << 8) | mRow[2 * i + 1]);
+		return true;
+	}
+
+	if (!read_values())
+		return false;
+
+	simd::kernels().mStoreU16(&mValues[0], dst, mValues.size());
+	return true;
+}
+
+bool reader::read_row(float* dst)
+{
+	if (!read_values())
+		return false;
+
+	memcpy(dst, &mValues[0], mValues.size() * sizeof(float));
+	return true;
+}
+
+writer::writer(void)
+	: mFile(nullptr),
+	  mWidth(0),
+	  mHeight(0),
+	  mChannels(0),
+	  mSamples(sample_type::u8),
+	  mFailed(false),
+	  mNextRow(0),
+	  mDataStart(0)
+{}
+
+writer::~writer(void)
+{
+	close();
+}
+
+bool writer::open(const char* path, uint32_t width, uint32_t height, uint32_t channels, sample_type samples)
+{
+	close();
+
+	const uint32_t LARGEST = (uint32_t(1) << 30) - 1;
+	if ((channels != 1 && channels != 3) || width < 1 || height < 1 || width > LARGEST || height > LARGEST)
+		return false;
+
+	FILE* file = fopen(path, "wb");
+	if (!file)
+		return false;
+
+	int written;
+	if (samples == sample_type::f32)
+		written = fprintf(file, "P%c\n%u %u\n-1.0\n", channels == 1 ? 'f' : 'F', width, height);
+	else
+		written = fprintf(file, "P%c\n%u %u\n%u\n", channels == 1 ? '5' : '6', width, height,
+						  samples == sample_type::u8 ? 255u : 65535u);
+
+	mDataStart = written > 0 ? tell(file) : -1;
+	if (mDataStart < 0) {
+		fclose(file);
+		remove(path);
+		return false;
+	}
+
+	mFile = file;
+	mWidth = width;
+	mHeight = height;
+	mChannels = channels;
+	mSamples = samples;
+	mFailed = false;
+	mNextRow = 0;
+
+	const size_t count = size_t(width) * channels;
+	mRow.resize(count * sample_bytes(samples));
+	mValues.resize(count);
+	mWords.resize(samples == sample_type::u16 ? count : 0);
+
+	return true;
+}
+
+bool writer::close(void)
+{
+	if (!mFile)
+		return false;
+
+	bool ok = !mFailed && mNextRow == mHeight;
+	ok = fclose(mFile) == 0 && ok;
+
+	mFile = nullptr;
+	return ok;
+}
+
+bool writer::write_file_row(void)
+{
+	if (!mFile || mFailed || mNextRow >= mHeight)
+		return false;
+
+	if (mSamples == sample_type::f32 && !seek(mFile, mDataStart + int64_t(mHeight - 1 - mNextRow) * int64_t(mRow.size())))
+		mFailed = true;
+	else if (fwrite(&mRow[0], 1, mRow.size(), mFile) != mRow.size())
+		mFailed = true;
+
+	++mNextRow;
+	return !mFailed;
+}
+
+// Writes mValues (normalized, unless the file holds floats) as the next row.
+bool writer::write_values(void)
+{
+	const size_t count = mValues.size();
+	const float* src = &mValues[0];
+
+	switch (mSamples) {
+	case sample_type::u8:
+		simd::kernels().mStoreU8(src, &mRow[0], count);
+		break;
+
+	case sample_type::u16:
+		simd::kernels().mStoreU16(src, &mWords[0], count);
+		for (size_t i = 0; i < count; ++i) {
+			mRow[2 * i] = uint8_t(mWords[i] >> 8);
+			mRow[2 * i + 1] = uint8_t(mWords[i]);
+		}
+		break;
+
+	case sample_type::f32:
+		memcpy(&mRow[0], src, count * sizeof(float));
+		if (!host_is_little_endian())
+			swap_floats(&mRow[0], count);
+		break;
+	}
+
+	return write_file_row();
+}
+
+bool writer::write_row(const uint8_t* src)
+{
+	if (mSamples == sample_type::u8) {
+		memcpy(&mRow[0], src, mRow.size());
+		return write_file_row();
+	}
+
+	simd::kernels().mLoadU8(src, &mValues[0], mValues.size());
+	return write_values();
+}
+
+bool writer::write_row(const uint16_t* src)
+{
+	if (mSamples == sample_type::u16) {
+		for (size_t i = 0; i < mValues.size(); ++i) {
+			mRow[2 * i] = uint8_t(src[i] >> 8);
+			mRow[2 * i + 1] = uint8_t(src[i]);
+		}
+		return write_file_row();
+	}
+
+	simd::kernels().mLoadU16(src, &mValues[0], mValues.size());
+	return write_values();
+}
+
+bool writer::write_row(const float* src)
+{
+	memcpy(&mValues[0], src, mValues.size() * sizeof(float));
+	return write_values();
+}
+
+} // namespace netpbm
+} // namespace img
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+// Row at a time access to netpbm files: binary PGM (P5) and PPM (P6), with up to 16
+// bits per channel, and PFM (Pf and PF), which holds floats. Nothing but the current
+// row is ever in memory, so images of any size can be read and written, as long as
+// whatever consumes (or produces) the rows can make do with a few of them at a time;
+// see img::read_rows, img::write_rows and the streaming img::apply_kernel.
+//
+// Rows come and go top to bottom. PFM stores them the other way around, so those
+// files are read and written with a seek per row, and have to be regular files.
+
+namespace img {
+namespace netpbm {
+
+// How a file stores its channels: 8 bits (maxval up to 255), 16 bits (big endian,
+// maxval up to 65535), or floats (PFM).
+enum class sample_type
+{
+	u8,
+	u16,
+	f32
+};
+
+// Rows can be read as any of uint8_t, uint16_t or float, whatever the file holds:
+// integer samples are normalized by the file's maxval, as img normalizes channels, and
+// converted like store_channels would; floats are taken as they are. A row which
+// isn't in the file's own sample type (or has a maxval of its own) goes through floats.
+struct reader
+{
+private:
+	FILE* mFile;
+	uint32_t mWidth;
+	uint32_t mHeight;
+	uint32_t mChannels;
+	uint32_t mMaxValue; // 0 for PFM
+	sample_type mSamples;
+	bool mSwapBytes; // the file's byte order isn't ours
+	uint32_t mNextRow;
+	int64_t mDataStart;
+	std::vector<uint8_t> mRow; // one row, as it is in the file
+	std::vector<float> mValues; // one row, normalized
+
+	bool read_file_row(void);
+
+	bool read_values(void);
+
+public:
+	reader(void);
+
+	~reader(void);
+
+	reader(const reader&) = delete;
+	reader& operator=(const reader&) = delete;
+
+	// Reads path's header; the first row is next. Returns false (and leaves nothing
+	// open) if the file can't be opened or isn't one of the formats above.
+	bool open(const char* path);
+
+	void close(void);
+
+	uint32_t width(void) const { return mWidth; }
+
+	uint32_t height(void) const { return mHeight; }
+
+	// 1 (PGM, Pf) or 3 (PPM, PF)
+	uint32_t channels(void) const { return mChannels; }
+
+	sample_type samples(void) const { return mSamples; }
+
+	// The row which read_row reads next; height() once they've all been read.
+	uint32_t next_row(void) const { return mNextRow; }
+
+	// Reads the next row: width() * channels() interleaved channels. Returns false
+	// once every row has been read, or if the file turns out to be short.
+	bool read_row(uint8_t* dst);
+
+	bool read_row(uint16_t* dst);
+
+	bool read_row(float* dst);
+};
+
+// Writes a file row by row, top to bottom: u8 and u16 give PGM or PPM (maxval 255
+// or 65535), and f32 gives PFM (little endian). Rows can be given in any of the
+// channel types reader reads, and are converted the same way it converts them.
+struct writer
+{
+private:
+	FILE* mFile;
+	uint32_t mWidth;
+	uint32_t mHeight;
+	uint32_t mChannels;
+	sample_type mSamples;
+	bool mFailed;
+	uint32_t mNextRow;
+	int64_t mDataStart;
+	std::vector<uint8_t> mRow;
+	std::vector<float> mValues;
+	std::vector<uint16_t> mWords;
+
+	bool write_file_row(void);
+
+	bool write_values(void);
+
+public:
+	writer(void);
+
+	~writer(void);
+
+	writer(const writer&) = delete;
+	writer& operator=(const writer&) = delete;
+
+	// Creates path and writes its header. channels has to be 1 or 3.
+	bool open(const char* path, uint32_t width, uint32_t height, uint32_t channels, sample_type samples);
+
+	// Closes the file. Returns false if anything went wrong along the way, or if
+	// fewer rows than height() were written (in which case the file is incomplete).
+	bool close(void);
+
+	uint32_t width(void) const { return mWidth; }
+
+	uint32_t height(void) const { return mHeight; }
+
+	uint32_t channels(void) const { return mChannels; }
+
+	sample_type samples(void) const { return mSamples; }
+
+	uint32_t next_row(void) const { return mNextRow; }
+
+	// Writes the next row: width() * channels() interleaved channels. Returns false
+	// once every row has been written, or if the write fails.
+	bool write_row(const uint8_t* src);
+
+	bool write_row(const uint16_t* src);
+
+	bool write_row(const float* src);
+};
+
+} // namespace netpbm
+} // namespace img
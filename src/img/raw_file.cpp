@@ -0,0 +1,179 @@
+#include "raw_file.h"
+#include "memory.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(EMSCRIPTEN)
+#	define IMG_RAW_MMAP
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+namespace img {
+namespace raw {
+
+size_t row_bytes(const header& h)
+{
+	static const size_t CHANNEL_BYTES[] = { 0, 1, 2, 2, 4 };
+	return h.mChannelType < 5 ? size_t(h.mWidth) * size_t(h.mChannels) * CHANNEL_BYTES[h.mChannelType] : 0;
+}
+
+bool is_valid(const header& h, size_t fileSize)
+{
+	if (fileSize < sizeof(header) || h.mMagic != MAGIC || h.mVersion != VERSION)
+		return false;
+
+	if (h.mChannelType < uint32_t(channel_type::u8) || h.mChannelType > uint32_t(channel_type::f32))
+		return false;
+
+	if (h.mChannels < 1 || h.mChannels > 4 || h.mFlipped > 1)
+		return false;
+
+	if (h.mStride % 64 != 0 || h.mStride < row_bytes(h) || h.mDataOffset < sizeof(header) || h.mDataOffset % 64 != 0)
+		return false;
+
+	// Dimensions are 32 bits and the stride is bounded by the file's size,
+	// so none of this can overflow
+	if (h.mDataOffset > fileSize || h.mStride > fileSize)
+		return false;
+
+	return uint64_t(h.mHeight) * h.mStride <= fileSize - h.mDataOffset;
+}
+
+bool write_file(const char* path, const header& h, const std::function<const void*(uint32_t)>& row)
+{
+	FILE* file = fopen(path, "wb");
+	if (!file)
+		return false;
+
+	const size_t rowBytes = row_bytes(h);
+	const std::vector<uint8_t> zeros(std::max(size_t(h.mDataOffset - sizeof(header)), size_t(h.mStride - rowBytes)), 0);
+
+	bool ok = fwrite(&h, sizeof(header), 1, file) == 1;
+	ok = ok && fwrite(zeros.data(), 1, size_t(h.mDataOffset) - sizeof(header), file) == size_t(h.mDataOffset) - sizeof(header);
+
+	for (uint32_t y = 0; ok && y < h.mHeight; ++y) {
+		ok = fwrite(row(y), 1, rowBytes, file) == rowBytes;
+		ok = ok && fwrite(zeros.data(), 1, size_t(h.mStride) - rowBytes, file) == size_t(h.mStride) - rowBytes;
+	}
+
+	ok = fclose(file) == 0 && ok;
+
+	if (!ok)
+		remove(path);
+
+	return ok;
+}
+
+mapped_file::mapped_file(void)
+	: mData(nullptr),
+	  mSize(0),
+	  mMapped(false)
+{}
+
+mapped_file::~mapped_file(void)
+{
+	close();
+}
+
+mapped_file::mapped_file(mapped_file&& other)
+	: mData(other.mData),
+	  mSize(other.mSize),
+	  mMapped(other.mMapped)
+{
+	other.mData = nullptr;
+	other.mSize = 0;
+	other.mMapped = false;
+}
+
+mapped_file& mapped_file::operator=(mapped_file&& other)
+{
+	if (this != &other) {
+		close();
+		std::swap(mData, other.mData);
+		std::swap(mSize, other.mSize);
+		std::swap(mMapped, other.mMapped);
+	}
+	return *this;
+}
+
+void mapped_file::close(void)
+{
+#ifdef IMG_RAW_MMAP
+	if (mMapped)
+		munmap(const_cast<uint8_t*>(mData), mSize);
+	else
+#endif
+	if (mData)
+		memory::release(const_cast<uint8_t*>(mData));
+
+	mData = nullptr;
+	mSize = 0;
+	mMapped = false;
+}
+
+bool mapped_file::open(const char* path)
+{
+	close();
+
+#ifdef IMG_RAW_MMAP
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		::close(fd);
+		return false;
+	}
+
+	// mmap refuses empty mappings; an empty file just has no data
+	if (info.st_size > 0) {
+		void* p = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED) {
+			::close(fd);
+			return false;
+		}
+
+		mData = (const uint8_t*) p;
+		mSize = size_t(info.st_size);
+		mMapped = true;
+	}
+
+	// The mapping holds on to the file by itself
+	::close(fd);
+	return true;
+#else
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	bool ok = fseek(file, 0, SEEK_END) == 0;
+	long size = ok ? ftell(file) : -1;
+	ok = size >= 0 && fseek(file, 0, SEEK_SET) == 0;
+
+	if (ok && size > 0) {
+		uint8_t* buffer = (uint8_t*) memory::allocate(size_t(size));
+		ok = fread(buffer, 1, size_t(size), file) == size_t(size);
+
+		if (ok) {
+			mData = buffer;
+			mSize = size_t(size);
+		} else {
+			memory::release(buffer);
+		}
+	}
+
+	fclose(file);
+	return ok;
+#endif
+}
+
+} // namespace raw
+} // namespace img
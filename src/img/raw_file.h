@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+
+// A container for images which are read far more often than they're written (assets,
+// mostly): a fixed size header, then the pixel rows exactly as img keeps them in memory,
+// padding and orientation included. Loading one is mapping the file; there's nothing
+// to decode and nothing to copy, so the cost is the page faults on the rows which
+// actually get touched. img::write_raw makes these files and img::map_file reads them.
+//
+// Everything is in the byte order of the machine which wrote the file (little endian
+// wherever this runs); a file from the other kind of machine fails the magic check.
+
+namespace img {
+namespace raw {
+
+// "IMGR"
+static const uint32_t MAGIC = 0x52474d49;
+
+// Bumped whenever the layout below changes; older versions are rejected.
+static const uint32_t VERSION = 1;
+
+// Where the first row starts. Mappings start on a page boundary, so rows in the
+// file (mStride being a multiple of it too) start on cache lines in memory.
+static const uint64_t DATA_OFFSET = 64;
+
+enum class channel_type : uint32_t
+{
+	u8 = 1,
+	u16 = 2,
+	f16 = 3, // img::half
+	f32 = 4
+};
+
+struct header
+{
+	uint32_t mMagic;
+	uint32_t mVersion;
+	uint32_t mWidth;
+	uint32_t mHeight;
+	uint32_t mChannels; // the value of the color_format
+	uint32_t mChannelType; // a channel_type
+	uint64_t mStride; // in bytes, a multiple of 64
+	uint32_t mFlipped; // 1 if the rows are stored bottom up, like data::mFlipped
+	uint32_t mReserved;
+	uint64_t mDataOffset;
+};
+
+static_assert(sizeof(header) == 48, "the header's layout is part of the format");
+
+// The bytes of a row's pixels, padding not included.
+size_t row_bytes(const header& h);
+
+// Whether h is a header this version reads, describing rows which all lie
+// within a file of fileSize bytes.
+bool is_valid(const header& h, size_t fileSize);
+
+// Writes h, followed by its mHeight rows: row(i) is the i-th row in file order, and
+// the first mWidth * mChannels channels of it are written, with zeros after them to
+// make up the stride. Returns false if the file can't be written.
+bool write_file(const char* path, const header& h, const std::function<const void*(uint32_t)>& row);
+
+// A read only file, in memory: mapped where that's possible (Linux and other POSIX
+// systems), or else read into a buffer which starts on a 64 byte boundary.
+// Either way the contents stay put for as long as the mapped_file (or whatever it's
+// moved into) is around.
+struct mapped_file
+{
+private:
+	const uint8_t* mData;
+	size_t mSize;
+	bool mMapped;
+
+	void close(void);
+
+public:
+	mapped_file(void);
+
+	~mapped_file(void);
+
+	mapped_file(mapped_file&& other);
+
+	mapped_file& operator=(mapped_file&& other);
+
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	// Replaces whatever was open before. Returns false if path can't be opened,
+	// in which case nothing is.
+	bool open(const char* path);
+
+	const uint8_t* data(void) const { return mData; }
+
+	size_t size(void) const { return mSize; }
+};
+
+} // namespace raw
+} // namespace img
@@ -0,0 +1,208 @@
+#include "resample.h"
+
+#include <math.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+namespace img {
+
+namespace {
+
+// How many tables the cache keeps before it starts dropping the oldest.
+const size_t CACHE_CAPACITY = 64;
+
+const double PI = 3.14159265358979323846;
+
+// Weights smaller than this are treated as zero
+const double ZERO = 1e-9;
+
+// The Kaiser window's shape parameter; 4 trades a little sharpness for very little ringing
+const double KAISER_ALPHA = 4.0;
+
+double support(resize_filter filter)
+{
+	switch (filter) {
+	case resize_filter::box:
+		return 0.5;
+	case resize_filter::bilinear:
+		return 1.0;
+	case resize_filter::bicubic:
+		return 2.0;
+	default:
+		return 3.0;
+	}
+}
+
+// The zeroth order modified Bessel function of the first kind, summed until the
+// terms stop mattering; it only ever sees arguments up to KAISER_ALPHA.
+double bessel_i0(double x)
+{
+	const double q = x * x * 0.25;
+	double sum = 1.0;
+	double term = 1.0;
+
+	for (int k = 1; term > sum * 1e-16; ++k) {
+		term *= q / double(k * k);
+		sum += term;
+	}
+
+	return sum;
+}
+
+double sinc(double x)
+{
+	if (x == 0.0)
+		return 1.0;
+	x *= PI;
+	return sin(x) / x;
+}
+
+double evaluate(resize_filter filter, double x)
+{
+	x = fabs(x);
+
+	switch (filter) {
+	case resize_filter::box:
+		return x < 0.5 ? 1.0 : (x == 0.5 ? 0.5 : 0.0);
+	case resize_filter::bilinear:
+		return x < 1.0 ? 1.0 - x : 0.0;
+	case resize_filter::bicubic:
+		if (x < 1.0)
+			return (1.5 * x - 2.5) * x * x + 1.0;
+		if (x < 2.0)
+			return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+		return 0.0;
+	case resize_filter::kaiser:
+		if (x < 3.0) {
+			const double r = x / 3.0;
+			return sinc(x) * bessel_i0(KAISER_ALPHA * sqrt(1.0 - r * r)) / bessel_i0(KAISER_ALPHA);
+		}
+		return 0.0;
+	default:
+		return x < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+	}
+}
+
+std::shared_ptr<const resample_table> build(size_t srcSize, size_t dstSize, resize_filter filter)
+{
+	const double scale = double(dstSize) / double(srcSize);
+
+	// Downscaling stretches the filter over the source, so it covers every source sample
+	const double stretch = scale < 1.0 ? 1.0 / scale : 1.0;
+	const double radius = support(filter) * stretch;
+	const int64_t last = int64_t(srcSize) - 1;
+
+	// The weights of each sample, folded onto [0, srcSize) and trimmed of zeros at either end
+	std::vector<int64_t> lo(dstSize);
+	std::vector<std::vector<double>> weights(dstSize);
+
+	size_t taps = 1;
+
+	for (size_t i = 0; i < dstSize; ++i) {
+		const double center = (double(i) + 0.5) / scale - 0.5;
+		const int64_t begin = int64_t(ceil(center - radius));
+		const int64_t end = int64_t(floor(center + radius));
+
+		int64_t first = std::min(std::max(begin, int64_t(0)), last);
+		int64_t stop = std::min(std::max(end, int64_t(0)), last);
+
+		std::vector<double> w(size_t(stop - first + 1), 0.0);
+		double total = 0.0;
+
+		for (int64_t j = begin; j <= end; ++j) {
+			double f = evaluate(filter, (double(j) - center) / stretch);
+			w[size_t(std::min(std::max(j, int64_t(0)), last) - first)] += f;
+			total += f;
+		}
+
+		// The sinc based filters are zero at whole numbers, give or take rounding; trimming
+		// those keeps e.g. a same size lanczos3 resize down to a single tap.
+		size_t head = 0;
+		size_t tail = w.size();
+		while (head + 1 < tail && fabs(w[head]) < ZERO)
+			++head;
+		while (tail - 1 > head && fabs(w[tail - 1]) < ZERO)
+			--tail;
+
+		lo[i] = first + int64_t(head);
+		weights[i].resize(tail - head);
+		for (size_t t = head; t < tail; ++t)
+			weights[i][t - head] = w[t] / total;
+
+		taps = std::max(taps, weights[i].size());
+	}
+
+	std::shared_ptr<resample_table> table(new resample_table());
+	table->mTaps = taps;
+	table->mFirst.resize(dstSize);
+	table->mWeights.assign(dstSize * taps, 0.0f);
+
+	// Every run is mTaps long, so the ones which would hang off the far edge start earlier
+	for (size_t i = 0; i < dstSize; ++i) {
+		int64_t first = std::min(lo[i], int64_t(srcSize - taps));
+		table->mFirst[i] = int32_t(first);
+
+		for (size_t t = 0; t < weights[i].size(); ++t)
+			table->mWeights[i * taps + size_t(lo[i] - first) + t] = float(weights[i][t]);
+	}
+
+	return table;
+}
+
+using cache_key = std::tuple<size_t, size_t, resize_filter>;
+
+struct cache
+{
+	std::mutex mLock;
+	std::map<cache_key, std::shared_ptr<const resample_table>> mTables;
+	std::vector<cache_key> mOrder; // oldest first
+};
+
+cache& shared_cache(void)
+{
+	static cache c;
+	return c;
+}
+
+} // namespace
+
+std::shared_ptr<const resample_table> resample_weights(size_t srcSize, size_t dstSize, resize_filter filter)
+{
+	cache& c = shared_cache();
+	const cache_key key(srcSize, dstSize, filter);
+
+	{
+		std::lock_guard<std::mutex> lock(c.mLock);
+		auto found = c.mTables.find(key);
+		if (found != c.mTables.end())
+			return found->second;
+	}
+
+	// Built outside of the lock; if two threads race for the same table, one of them wins
+	std::shared_ptr<const resample_table> table(build(srcSize, dstSize, filter));
+
+	std::lock_guard<std::mutex> lock(c.mLock);
+	auto inserted = c.mTables.insert(std::make_pair(key, table));
+	if (!inserted.second)
+		return inserted.first->second;
+
+	c.mOrder.push_back(key);
+	if (c.mOrder.size() > CACHE_CAPACITY) {
+		c.mTables.erase(c.mOrder.front());
+		c.mOrder.erase(c.mOrder.begin());
+	}
+
+	return table;
+}
+
+void clear_resample_cache(void)
+{
+	cache& c = shared_cache();
+	std::lock_guard<std::mutex> lock(c.mLock);
+	c.mTables.clear();
+	c.mOrder.clear();
+}
+
+} // namespace img
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+// Weight tables for img::resize. A table maps every destination sample along one
+// axis onto a run of mTaps consecutive source samples and the weights to blend them
+// with. Computing one takes a filter evaluation per tap, so tables are cached, keyed
+// by source size, destination size and filter; resizing a batch of images which
+// share their dimensions only ever builds two.
+
+namespace img {
+
+enum class resize_filter
+{
+	box, // the average of the covered source pixels; integer factor downscales have a fast path
+	bilinear, // triangle, support 1
+	bicubic, // Catmull-Rom (Keys, a = -0.5), support 2; sharp, slight overshoot
+	lanczos3, // windowed sinc, support 3; the sharpest, and the most overshoot
+	kaiser // sinc under a Kaiser window, support 3; almost as sharp as lanczos3, with less ringing
+};
+
+struct resample_table
+{
+	size_t mTaps; // the same for every sample, padded with zero weights where needed
+	std::vector<int32_t> mFirst; // per destination sample: the first source sample read
+	std::vector<float> mWeights; // per destination sample, mTaps each; they add up to 1
+
+	// Source samples past the edges are clamped to them, so
+	// mFirst[i] + mTaps never exceeds the source size.
+};
+
+// The (possibly cached) table for resampling srcSize samples to dstSize; both have to be positive.
+std::shared_ptr<const resample_table> resample_weights(size_t srcSize, size_t dstSize, resize_filter filter);
+
+// Clears the cache; tables still in use stay alive until they're released.
+void clear_resample_cache(void);
+
+} // namespace img
@@ -0,0 +1,787 @@
+#include "simd.h"
+
+#include <math.h>
+#include <string.h>
+
+#if !defined(EMSCRIPTEN) && (defined(__x86_64__) || defined(_M_X64) || \
+	defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#	define IMG_SIMD_X86
+#	include <emmintrin.h>
+#	include <immintrin.h>
+#	if defined(_MSC_VER)
+#		include <intrin.h>
+#		define IMG_TARGET_AVX2
+#	else
+#		define IMG_TARGET_AVX2 __attribute__((target("avx2")))
+#	endif
+#endif
+
+// None of the kernels below may use FMA: a fused multiply-add rounds once
+// instead of twice, which would break the bit for bit guarantee.
+
+namespace img {
+namespace simd {
+
+namespace {
+
+//-------------------------------------------------------------------------------------------------
+// scalar
+//-------------------------------------------------------------------------------------------------
+
+void muladd_scalar(float* accum, const float* taps, float weight, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		accum[i] += taps[i] * weight;
+}
+
+void load_u8_scalar(const uint8_t* src, float* dst, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		dst[i] = float(src[i]) / 255.0f;
+}
+
+// The comparisons are ordered the same way as minps/maxps, so
+// NaNs end up as 0 in both this and the vector versions.
+void store_u8_scalar(const float* src, uint8_t* dst, size_t count)
+{
+	for (size_t i = 0; i < count; ++i) {
+		float x = src[i] * 255.0f;
+		x = x > 0.0f ? x : 0.0f;
+		x = x < 255.0f ? x : 255.0f;
+		dst[i] = uint8_t(int32_t(x));
+	}
+}
+
+void store_f32_scalar(const float* src, float* dst, size_t count)
+{
+	for (size_t i = 0; i < count; ++i) {
+		float x = src[i];
+		x = x > 0.0f ? x : 0.0f;
+		dst[i] = x < 1.0f ? x : 1.0f;
+	}
+}
+
+void load_u16_scalar(const uint16_t* src, float* dst, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		dst[i] = float(src[i]) / 65535.0f;
+}
+
+void store_u16_scalar(const float* src, uint16_t* dst, size_t count)
+{
+	for (size_t i = 0; i < count; ++i) {
+		float x = src[i] * 65535.0f;
+		x = x > 0.0f ? x : 0.0f;
+		x = x < 65535.0f ? x : 65535.0f;
+		dst[i] = uint16_t(int32_t(x));
+	}
+}
+
+void combine3_scalar(const float* a, const float* b, const float* c, float wa, float wb, float wc, float offset,
+					 float* dst, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		dst[i] = ((a[i] * wa + b[i] * wb) + c[i] * wc) + offset;
+}
+
+void load_u8_to_i16_scalar(const uint8_t* src, int16_t* dst, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		dst[i] = int16_t(src[i]);
+}
+
+void muladd2_i16_scalar(int32_t* accum, const int16_t* a, const int16_t* b, int16_t wa, int16_t wb, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		accum[i] += int32_t(a[i]) * wa + int32_t(b[i]) * wb;
+}
+
+void store_i32_to_u8_scalar(const int32_t* accum, int shift, uint8_t* dst, size_t count)
+{
+	for (size_t i = 0; i < count; ++i) {
+		int32_t x = accum[i] >> shift;
+		x = x > 0 ? x : 0;
+		dst[i] = uint8_t(x < 255 ? x : 255);
+	}
+}
+
+// Outputs [first, count); the vector versions finish their rows with this. The weights
+// are laid out by the length of the whole row, so it can't just be offset like the others.
+void resample_from(size_t first, const float* src, const int32_t* offsets, const float* weights, size_t taps,
+				   size_t tapStride, float* dst, size_t count)
+{
+	for (size_t i = first; i < count; ++i) {
+		const float* s = src + offsets[i];
+		float sum = 0.0f;
+		for (size_t t = 0; t < taps; ++t)
+			sum += weights[t * count + i] * s[t * tapStride];
+		dst[i] = sum;
+	}
+}
+
+void resample_scalar(const float* src, const int32_t* offsets, const float* weights, size_t taps, size_t tapStride,
+					 float* dst, size_t count)
+{
+	resample_from(0, src, offsets, weights, taps, tapStride, dst, count);
+}
+
+// tan(22.5) and tan(67.5), which split the plane into the 8 directions of mGradient
+const float TAN_22_5 = 0.41421356f;
+const float TAN_67_5 = 2.41421356f;
+
+// The direction of (dx, dy), with the same comparisons the vector versions make, so
+// NaNs go the same way (to 7) in all of them.
+uint8_t orientation_of(float dx, float dy)
+{
+	const float ax = fabsf(dx);
+	const float ay = fabsf(dy);
+	const int neg = dx < 0.0f ? 1 : 0;
+
+	if (ay <= ax * TAN_22_5)
+		return uint8_t(neg * 4);
+	if (ay > ax * TAN_67_5)
+		return uint8_t(dy > 0.0f ? 2 : 6);
+	return uint8_t(dy > 0.0f ? 1 + neg * 2 : 7 - neg * 2);
+}
+
+void gradient_scalar(const float* above, const float* row, const float* below, float side, float centre, float* dx,
+					 float* dy, float* magnitude, uint8_t* orientation, size_t count)
+{
+	for (size_t i = 0; i < count; ++i) {
+		const float* a = above + i;
+		const float* r = row + i;
+		const float* b = below + i;
+
+		const float s0 = (a[0] + b[0]) * side + r[0] * centre;
+		const float s2 = (a[2] + b[2]) * side + r[2] * centre;
+		const float x = s2 - s0;
+		const float y = ((b[0] - a[0]) + (b[2] - a[2])) * side + (b[1] - a[1]) * centre;
+
+		dx[i] = x;
+		dy[i] = y;
+		magnitude[i] = sqrtf(x * x + y * y);
+		orientation[i] = orientation_of(x, y);
+	}
+}
+
+#ifdef IMG_SIMD_X86
+
+//-------------------------------------------------------------------------------------------------
+// SSE2
+//-------------------------------------------------------------------------------------------------
+
+void muladd_sse2(float* accum, const float* taps, float weight, size_t count)
+{
+	const __m128 w = _mm_set1_ps(weight);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128 a0 = _mm_add_ps(_mm_loadu_ps(accum + i), _mm_mul_ps(_mm_loadu_ps(taps + i), w));
+		__m128 a1 = _mm_add_ps(_mm_loadu_ps(accum + i + 4), _mm_mul_ps(_mm_loadu_ps(taps + i + 4), w));
+		_mm_storeu_ps(accum + i, a0);
+		_mm_storeu_ps(accum + i + 4, a1);
+	}
+
+	muladd_scalar(accum + i, taps + i, weight, count - i);
+}
+
+void load_u8_sse2(const uint8_t* src, float* dst, size_t count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 scale = _mm_set1_ps(255.0f);
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i lo = _mm_unpacklo_epi8(bytes, zero);
+		__m128i hi = _mm_unpackhi_epi8(bytes, zero);
+
+		_mm_storeu_ps(dst + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+		_mm_storeu_ps(dst + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+		_mm_storeu_ps(dst + i + 8, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+		_mm_storeu_ps(dst + i + 12, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+	}
+
+	load_u8_scalar(src + i, dst + i, count - i);
+}
+
+static inline __m128i to_int_sse2(const float* src, __m128 scale, __m128 lower, __m128 upper)
+{
+	__m128 x = _mm_mul_ps(_mm_loadu_ps(src), scale);
+	return _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(x, lower), upper));
+}
+
+void store_u8_sse2(const float* src, uint8_t* dst, size_t count)
+{
+	const __m128 scale = _mm_set1_ps(255.0f);
+	const __m128 lower = _mm_setzero_ps();
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i a = to_int_sse2(src + i, scale, lower, scale);
+		__m128i b = to_int_sse2(src + i + 4, scale, lower, scale);
+		__m128i c = to_int_sse2(src + i + 8, scale, lower, scale);
+		__m128i d = to_int_sse2(src + i + 12, scale, lower, scale);
+
+		__m128i bytes = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+		_mm_storeu_si128((__m128i*)(dst + i), bytes);
+	}
+
+	store_u8_scalar(src + i, dst + i, count - i);
+}
+
+void store_f32_sse2(const float* src, float* dst, size_t count)
+{
+	const __m128 lower = _mm_setzero_ps();
+	const __m128 upper = _mm_set1_ps(1.0f);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(dst + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), lower), upper));
+
+	store_f32_scalar(src + i, dst + i, count - i);
+}
+
+void load_u16_sse2(const uint16_t* src, float* dst, size_t count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 scale = _mm_set1_ps(65535.0f);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i words = _mm_loadu_si128((const __m128i*)(src + i));
+
+		_mm_storeu_ps(dst + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero)), scale));
+		_mm_storeu_ps(dst + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(words, zero)), scale));
+	}
+
+	load_u16_scalar(src + i, dst + i, count - i);
+}
+
+// SSE2 can only pack dwords into words with signed saturation, so the values are
+// moved down into the signed range for packing and back up afterwards.
+void store_u16_sse2(const float* src, uint16_t* dst, size_t count)
+{
+	const __m128 scale = _mm_set1_ps(65535.0f);
+	const __m128 lower = _mm_setzero_ps();
+	const __m128i bias = _mm_set1_epi32(32768);
+	const __m128i unbias = _mm_set1_epi16(-32768);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = _mm_sub_epi32(to_int_sse2(src + i, scale, lower, scale), bias);
+		__m128i b = _mm_sub_epi32(to_int_sse2(src + i + 4, scale, lower, scale), bias);
+
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(_mm_packs_epi32(a, b), unbias));
+	}
+
+	store_u16_scalar(src + i, dst + i, count - i);
+}
+
+void combine3_sse2(const float* a, const float* b, const float* c, float wa, float wb, float wc, float offset,
+				   float* dst, size_t count)
+{
+	const __m128 va = _mm_set1_ps(wa);
+	const __m128 vb = _mm_set1_ps(wb);
+	const __m128 vc = _mm_set1_ps(wc);
+	const __m128 vo = _mm_set1_ps(offset);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 x = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a + i), va), _mm_mul_ps(_mm_loadu_ps(b + i), vb));
+		x = _mm_add_ps(_mm_add_ps(x, _mm_mul_ps(_mm_loadu_ps(c + i), vc)), vo);
+		_mm_storeu_ps(dst + i, x);
+	}
+
+	combine3_scalar(a + i, b + i, c + i, wa, wb, wc, offset, dst + i, count - i);
+}
+
+void gradient_sse2(const float* above, const float* row, const float* below, float side, float centre, float* dx,
+				   float* dy, float* magnitude, uint8_t* orientation, size_t count)
+{
+	const __m128 vs = _mm_set1_ps(side);
+	const __m128 vc = _mm_set1_ps(centre);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 noSign = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const __m128 tan22 = _mm_set1_ps(TAN_22_5);
+	const __m128 tan67 = _mm_set1_ps(TAN_67_5);
+	const __m128i two = _mm_set1_epi32(2);
+	const __m128i four = _mm_set1_epi32(4);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const __m128 a0 = _mm_loadu_ps(above + i), a1 = _mm_loadu_ps(above + i + 1), a2 = _mm_loadu_ps(above + i + 2);
+		const __m128 r0 = _mm_loadu_ps(row + i), r2 = _mm_loadu_ps(row + i + 2);
+		const __m128 b0 = _mm_loadu_ps(below + i), b1 = _mm_loadu_ps(below + i + 1), b2 = _mm_loadu_ps(below + i + 2);
+
+		const __m128 s0 = _mm_add_ps(_mm_mul_ps(_mm_add_ps(a0, b0), vs), _mm_mul_ps(r0, vc));
+		const __m128 s2 = _mm_add_ps(_mm_mul_ps(_mm_add_ps(a2, b2), vs), _mm_mul_ps(r2, vc));
+		const __m128 x = _mm_sub_ps(s2, s0);
+		const __m128 y = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_sub_ps(b0, a0), _mm_sub_ps(b2, a2)), vs),
+									_mm_mul_ps(_mm_sub_ps(b1, a1), vc));
+
+		_mm_storeu_ps(dx + i, x);
+		_mm_storeu_ps(dy + i, y);
+		_mm_storeu_ps(magnitude + i, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y))));
+
+		const __m128 ax = _mm_and_ps(x, noSign);
+		const __m128 ay = _mm_and_ps(y, noSign);
+		const __m128i shallow = _mm_castps_si128(_mm_cmple_ps(ay, _mm_mul_ps(ax, tan22)));
+		const __m128i steep = _mm_castps_si128(_mm_cmpgt_ps(ay, _mm_mul_ps(ax, tan67)));
+		const __m128i neg = _mm_castps_si128(_mm_cmplt_ps(x, zero));
+		const __m128i down = _mm_castps_si128(_mm_cmpgt_ps(y, zero));
+
+		// The same choices as orientation_of, as selects
+		const __m128i across = _mm_and_si128(neg, four);
+		const __m128i upright = _mm_sub_epi32(_mm_set1_epi32(6), _mm_and_si128(down, four));
+		const __m128i turn = _mm_and_si128(neg, two);
+		const __m128i diagonal = _mm_or_si128(_mm_and_si128(down, _mm_add_epi32(_mm_set1_epi32(1), turn)),
+											  _mm_andnot_si128(down, _mm_sub_epi32(_mm_set1_epi32(7), turn)));
+		__m128i dir = _mm_or_si128(_mm_and_si128(steep, upright), _mm_andnot_si128(steep, diagonal));
+		dir = _mm_or_si128(_mm_and_si128(shallow, across), _mm_andnot_si128(shallow, dir));
+
+		dir = _mm_packs_epi32(dir, dir);
+		const int32_t bytes = _mm_cvtsi128_si32(_mm_packus_epi16(dir, dir));
+		memcpy(orientation + i, &bytes, 4);
+	}
+
+	gradient_scalar(above + i, row + i, below + i, side, centre, dx + i, dy + i, magnitude + i, orientation + i,
+					count - i);
+}
+
+void load_u8_to_i16_sse2(const uint8_t* src, int16_t* dst, size_t count)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(src + i));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi8(bytes, zero));
+		_mm_storeu_si128((__m128i*)(dst + i + 8), _mm_unpackhi_epi8(bytes, zero));
+	}
+
+	load_u8_to_i16_scalar(src + i, dst + i, count - i);
+}
+
+void muladd2_i16_sse2(int32_t* accum, const int16_t* a, const int16_t* b, int16_t wa, int16_t wb, size_t count)
+{
+	// (wa, wb) pairs; interleaving a and b lines each pair up with its weight
+	const __m128i w = _mm_set1_epi32(int32_t(uint16_t(wa)) | (int32_t(uint16_t(wb)) << 16));
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+
+		__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(va, vb), w);
+		__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(va, vb), w);
+
+		_mm_storeu_si128((__m128i*)(accum + i), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(accum + i)), lo));
+		_mm_storeu_si128((__m128i*)(accum + i + 4), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(accum + i + 4)), hi));
+	}
+
+	muladd2_i16_scalar(accum + i, a + i, b + i, wa, wb, count - i);
+}
+
+void store_i32_to_u8_sse2(const int32_t* accum, int shift, uint8_t* dst, size_t count)
+{
+	const __m128i bits = _mm_cvtsi32_si128(shift);
+
+	// packs/packus saturate, which takes care of the clamp
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i a = _mm_sra_epi32(_mm_loadu_si128((const __m128i*)(accum + i)), bits);
+		__m128i b = _mm_sra_epi32(_mm_loadu_si128((const __m128i*)(accum + i + 4)), bits);
+		__m128i c = _mm_sra_epi32(_mm_loadu_si128((const __m128i*)(accum + i + 8)), bits);
+		__m128i d = _mm_sra_epi32(_mm_loadu_si128((const __m128i*)(accum + i + 12)), bits);
+
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+	}
+
+	store_i32_to_u8_scalar(accum + i, shift, dst + i, count - i);
+}
+
+// No gathers before AVX2, so the four sources are loaded one by one.
+void resample_sse2(const float* src, const int32_t* offsets, const float* weights, size_t taps, size_t tapStride,
+				   float* dst, size_t count)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const float* s0 = src + offsets[i];
+		const float* s1 = src + offsets[i + 1];
+		const float* s2 = src + offsets[i + 2];
+		const float* s3 = src + offsets[i + 3];
+
+		__m128 sum = _mm_setzero_ps();
+		for (size_t t = 0, o = 0; t < taps; ++t, o += tapStride) {
+			__m128 s = _mm_setr_ps(s0[o], s1[o], s2[o], s3[o]);
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(weights + t * count + i), s));
+		}
+
+		_mm_storeu_ps(dst + i, sum);
+	}
+
+	resample_from(i, src, offsets, weights, taps, tapStride, dst, count);
+}
+
+//-------------------------------------------------------------------------------------------------
+// AVX2
+//-------------------------------------------------------------------------------------------------
+
+IMG_TARGET_AVX2 void muladd_avx2(float* accum, const float* taps, float weight, size_t count)
+{
+	const __m256 w = _mm256_set1_ps(weight);
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m256 a0 = _mm256_add_ps(_mm256_loadu_ps(accum + i), _mm256_mul_ps(_mm256_loadu_ps(taps + i), w));
+		__m256 a1 = _mm256_add_ps(_mm256_loadu_ps(accum + i + 8), _mm256_mul_ps(_mm256_loadu_ps(taps + i + 8), w));
+		_mm256_storeu_ps(accum + i, a0);
+		_mm256_storeu_ps(accum + i + 8, a1);
+	}
+
+	muladd_scalar(accum + i, taps + i, weight, count - i);
+}
+
+IMG_TARGET_AVX2 void load_u8_avx2(const uint8_t* src, float* dst, size_t count)
+{
+	const __m256 scale = _mm256_set1_ps(255.0f);
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(src + i));
+		__m256i lo = _mm256_cvtepu8_epi32(bytes);
+		__m256i hi = _mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8));
+
+		_mm256_storeu_ps(dst + i, _mm256_div_ps(_mm256_cvtepi32_ps(lo), scale));
+		_mm256_storeu_ps(dst + i + 8, _mm256_div_ps(_mm256_cvtepi32_ps(hi), scale));
+	}
+
+	load_u8_scalar(src + i, dst + i, count - i);
+}
+
+IMG_TARGET_AVX2 static inline __m256i to_int_avx2(const float* src, __m256 scale, __m256 lower, __m256 upper)
+{
+	__m256 x = _mm256_mul_ps(_mm256_loadu_ps(src), scale);
+	return _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(x, lower), upper));
+}
+
+IMG_TARGET_AVX2 void store_u8_avx2(const float* src, uint8_t* dst, size_t count)
+{
+	const __m256 scale = _mm256_set1_ps(255.0f);
+	const __m256 lower = _mm256_setzero_ps();
+
+	// The packs work within each 128 bit lane, so the dwords come out
+	// as a0 b0 c0 d0 a1 b1 c1 d1 and need to be put back in order.
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32) {
+		__m256i a = to_int_avx2(src + i, scale, lower, scale);
+		__m256i b = to_int_avx2(src + i + 8, scale, lower, scale);
+		__m256i c = to_int_avx2(src + i + 16, scale, lower, scale);
+		__m256i d = to_int_avx2(src + i + 24, scale, lower, scale);
+
+		__m256i bytes = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_permutevar8x32_epi32(bytes, order));
+	}
+
+	store_u8_sse2(src + i, dst + i, count - i);
+}
+
+IMG_TARGET_AVX2 void store_f32_avx2(const float* src, float* dst, size_t count)
+{
+	const __m256 lower = _mm256_setzero_ps();
+	const __m256 upper = _mm256_set1_ps(1.0f);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_ps(dst + i, _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i), lower), upper));
+
+	store_f32_scalar(src + i, dst + i, count - i);
+}
+
+IMG_TARGET_AVX2 void load_u16_avx2(const uint16_t* src, float* dst, size_t count)
+{
+	const __m256 scale = _mm256_set1_ps(65535.0f);
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m256i lo = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+		__m256i hi = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i + 8)));
+
+		_mm256_storeu_ps(dst + i, _mm256_div_ps(_mm256_cvtepi32_ps(lo), scale));
+		_mm256_storeu_ps(dst + i + 8, _mm256_div_ps(_mm256_cvtepi32_ps(hi), scale));
+	}
+
+	load_u16_scalar(src + i, dst + i, count - i);
+}
+
+IMG_TARGET_AVX2 void store_u16_avx2(const float* src, uint16_t* dst, size_t count)
+{
+	const __m256 scale = _mm256_set1_ps(65535.0f);
+	const __m256 lower = _mm256_setzero_ps();
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m256i a = to_int_avx2(src + i, scale, lower, scale);
+		__m256i b = to_int_avx2(src + i + 8, scale, lower, scale);
+
+		// As for bytes, the pack interleaves the two halves of a and b
+		__m256i words = _mm256_packus_epi32(a, b);
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(words, _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+
+	store_u16_sse2(src + i, dst + i, count - i);
+}
+
+IMG_TARGET_AVX2 void combine3_avx2(const float* a, const float* b, const float* c, float wa, float wb, float wc,
+								   float offset, float* dst, size_t count)
+{
+	const __m256 va = _mm256_set1_ps(wa);
+	const __m256 vb = _mm256_set1_ps(wb);
+	const __m256 vc = _mm256_set1_ps(wc);
+	const __m256 vo = _mm256_set1_ps(offset);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 x = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(a + i), va), _mm256_mul_ps(_mm256_loadu_ps(b + i), vb));
+		x = _mm256_add_ps(_mm256_add_ps(x, _mm256_mul_ps(_mm256_loadu_ps(c + i), vc)), vo);
+		_mm256_storeu_ps(dst + i, x);
+	}
+
+	combine3_scalar(a + i, b + i, c + i, wa, wb, wc, offset, dst + i, count - i);
+}
+
+IMG_TARGET_AVX2 void gradient_avx2(const float* above, const float* row, const float* below, float side, float centre,
+								   float* dx, float* dy, float* magnitude, uint8_t* orientation, size_t count)
+{
+	const __m256 vs = _mm256_set1_ps(side);
+	const __m256 vc = _mm256_set1_ps(centre);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 noSign = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	const __m256 tan22 = _mm256_set1_ps(TAN_22_5);
+	const __m256 tan67 = _mm256_set1_ps(TAN_67_5);
+	const __m256i two = _mm256_set1_epi32(2);
+	const __m256i four = _mm256_set1_epi32(4);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m256 a0 = _mm256_loadu_ps(above + i), a1 = _mm256_loadu_ps(above + i + 1),
+					 a2 = _mm256_loadu_ps(above + i + 2);
+		const __m256 r0 = _mm256_loadu_ps(row + i), r2 = _mm256_loadu_ps(row + i + 2);
+		const __m256 b0 = _mm256_loadu_ps(below + i), b1 = _mm256_loadu_ps(below + i + 1),
+					 b2 = _mm256_loadu_ps(below + i + 2);
+
+		const __m256 s0 = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(a0, b0), vs), _mm256_mul_ps(r0, vc));
+		const __m256 s2 = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(a2, b2), vs), _mm256_mul_ps(r2, vc));
+		const __m256 x = _mm256_sub_ps(s2, s0);
+		const __m256 y = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_sub_ps(b0, a0), _mm256_sub_ps(b2, a2)), vs),
+									   _mm256_mul_ps(_mm256_sub_ps(b1, a1), vc));
+
+		_mm256_storeu_ps(dx + i, x);
+		_mm256_storeu_ps(dy + i, y);
+		_mm256_storeu_ps(magnitude + i, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y))));
+
+		const __m256 ax = _mm256_and_ps(x, noSign);
+		const __m256 ay = _mm256_and_ps(y, noSign);
+		const __m256i shallow = _mm256_castps_si256(_mm256_cmp_ps(ay, _mm256_mul_ps(ax, tan22), _CMP_LE_OQ));
+		const __m256i steep = _mm256_castps_si256(_mm256_cmp_ps(ay, _mm256_mul_ps(ax, tan67), _CMP_GT_OQ));
+		const __m256i neg = _mm256_castps_si256(_mm256_cmp_ps(x, zero, _CMP_LT_OQ));
+		const __m256i down = _mm256_castps_si256(_mm256_cmp_ps(y, zero, _CMP_GT_OQ));
+
+		const __m256i across = _mm256_and_si256(neg, four);
+		const __m256i upright = _mm256_sub_epi32(_mm256_set1_epi32(6), _mm256_and_si256(down, four));
+		const __m256i turn = _mm256_and_si256(neg, two);
+		const __m256i diagonal = _mm256_blendv_epi8(_mm256_sub_epi32(_mm256_set1_epi32(7), turn),
+													_mm256_add_epi32(_mm256_set1_epi32(1), turn), down);
+		__m256i dir = _mm256_blendv_epi8(diagonal, upright, steep);
+		dir = _mm256_blendv_epi8(dir, across, shallow);
+
+		const __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(dir), _mm256_extracti128_si256(dir, 1));
+		_mm_storel_epi64((__m128i*)(orientation + i), _mm_packus_epi16(words, words));
+	}
+
+	gradient_sse2(above + i, row + i, below + i, side, centre, dx + i, dy + i, magnitude + i, orientation + i,
+				  count - i);
+}
+
+IMG_TARGET_AVX2 void load_u8_to_i16_avx2(const uint8_t* src, int16_t* dst, size_t count)
+{
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(src + i));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_cvtepu8_epi16(bytes));
+	}
+
+	load_u8_to_i16_scalar(src + i, dst + i, count - i);
+}
+
+IMG_TARGET_AVX2 void muladd2_i16_avx2(int32_t* accum, const int16_t* a, const int16_t* b, int16_t wa, int16_t wb,
+									 size_t count)
+{
+	const __m256i w = _mm256_set1_epi32(int32_t(uint16_t(wa)) | (int32_t(uint16_t(wb)) << 16));
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+
+		// The unpacks stay within 128 bit lanes: lo holds sums 0-3 and 8-11, hi holds 4-7 and 12-15.
+		__m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(va, vb), w);
+		__m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(va, vb), w);
+
+		__m256i first = _mm256_permute2x128_si256(lo, hi, 0x20);
+		__m256i second = _mm256_permute2x128_si256(lo, hi, 0x31);
+
+		_mm256_storeu_si256((__m256i*)(accum + i),
+							_mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(accum + i)), first));
+		_mm256_storeu_si256((__m256i*)(accum + i + 8),
+							_mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(accum + i + 8)), second));
+	}
+
+	muladd2_i16_scalar(accum + i, a + i, b + i, wa, wb, count - i);
+}
+
+IMG_TARGET_AVX2 void store_i32_to_u8_avx2(const int32_t* accum, int shift, uint8_t* dst, size_t count)
+{
+	const __m128i bits = _mm_cvtsi32_si128(shift);
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32) {
+		__m256i a = _mm256_sra_epi32(_mm256_loadu_si256((const __m256i*)(accum + i)), bits);
+		__m256i b = _mm256_sra_epi32(_mm256_loadu_si256((const __m256i*)(accum + i + 8)), bits);
+		__m256i c = _mm256_sra_epi32(_mm256_loadu_si256((const __m256i*)(accum + i + 16)), bits);
+		__m256i d = _mm256_sra_epi32(_mm256_loadu_si256((const __m256i*)(accum + i + 24)), bits);
+
+		__m256i bytes = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_permutevar8x32_epi32(bytes, order));
+	}
+
+	store_i32_to_u8_sse2(accum + i, shift, dst + i, count - i);
+}
+
+IMG_TARGET_AVX2 void resample_avx2(const float* src, const int32_t* offsets, const float* weights, size_t taps,
+								  size_t tapStride, float* dst, size_t count)
+{
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m256i index = _mm256_loadu_si256((const __m256i*)(offsets + i));
+
+		__m256 sum = _mm256_setzero_ps();
+		for (size_t t = 0; t < taps; ++t) {
+			__m256 s = _mm256_i32gather_ps(src + t * tapStride, index, 4);
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(weights + t * count + i), s));
+		}
+
+		_mm256_storeu_ps(dst + i, sum);
+	}
+
+	resample_from(i, src, offsets, weights, taps, tapStride, dst, count);
+}
+
+//-------------------------------------------------------------------------------------------------
+// CPU detection
+//-------------------------------------------------------------------------------------------------
+
+bool host_supports(isa which)
+{
+	if (which == isa::scalar)
+		return true;
+
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return which == isa::sse2;
+
+	__cpuid(info, 1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+
+	if (which == isa::sse2)
+		return sse2;
+
+	// The OS has to save the upper halves of the ymm registers for us
+	if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	// libgcc checks XCR0 for us before reporting avx2
+	__builtin_cpu_init();
+	if (which == isa::sse2)
+		return __builtin_cpu_supports("sse2");
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // IMG_SIMD_X86
+
+const row_kernels SCALAR = {
+	isa::scalar,
+	muladd_scalar, load_u8_scalar, store_u8_scalar, store_f32_scalar,
+	load_u8_to_i16_scalar, muladd2_i16_scalar, store_i32_to_u8_scalar,
+	resample_scalar,
+	combine3_scalar, load_u16_scalar, store_u16_scalar,
+	gradient_scalar
+};
+
+#ifdef IMG_SIMD_X86
+const row_kernels SSE2 = {
+	isa::sse2,
+	muladd_sse2, load_u8_sse2, store_u8_sse2, store_f32_sse2,
+	load_u8_to_i16_sse2, muladd2_i16_sse2, store_i32_to_u8_sse2,
+	resample_sse2,
+	combine3_sse2, load_u16_sse2, store_u16_sse2,
+	gradient_sse2
+};
+
+const row_kernels AVX2 = {
+	isa::avx2,
+	muladd_avx2, load_u8_avx2, store_u8_avx2, store_f32_avx2,
+	load_u8_to_i16_avx2, muladd2_i16_avx2, store_i32_to_u8_avx2,
+	resample_avx2,
+	combine3_avx2, load_u16_avx2, store_u16_avx2,
+	gradient_avx2
+};
+#endif
+
+} // namespace
+
+const row_kernels& kernels(isa which)
+{
+#ifdef IMG_SIMD_X86
+	if (which == isa::avx2 && host_supports(isa::avx2))
+		return AVX2;
+
+	if (which != isa::scalar && host_supports(isa::sse2))
+		return SSE2;
+#endif
+	(void) which;
+	return SCALAR;
+}
+
+const row_kernels& kernels(void)
+{
+	static const row_kernels& best = kernels(isa::avx2);
+	return best;
+}
+
+const char* to_string(isa which)
+{
+	switch (which) {
+	case isa::sse2:
+		return "sse2";
+	case isa::avx2:
+		return "avx2";
+	default:
+		return "scalar";
+	}
+}
+
+} // namespace simd
+} // namespace img
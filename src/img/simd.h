@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Row kernels used by the convolution, resampling and conversion engines in img.h.
+// Every function here works on a flat run of channels, so the same kernels serve RGB
+// and greyscale images alike. The instruction set is picked once, the first time kernels()
+// is called, from what CPUID reports; all of the variants produce bit for bit
+// the same output as the scalar one.
+
+namespace img {
+namespace simd {
+
+enum class isa
+{
+	scalar,
+	sse2,
+	avx2
+};
+
+struct row_kernels
+{
+	isa mIsa;
+
+	// accum[i] += taps[i] * weight
+	void (*mMulAdd)(float* accum, const float* taps, float weight, size_t count);
+
+	// dst[i] = float(src[i]) / 255.0f
+	void (*mLoadU8)(const uint8_t* src, float* dst, size_t count);
+
+	// dst[i] = uint8_t(clamp(src[i] * 255.0f, 0.0f, 255.0f))
+	void (*mStoreU8)(const float* src, uint8_t* dst, size_t count);
+
+	// dst[i] = clamp(src[i], 0.0f, 1.0f)
+	void (*mStoreF32)(const float* src, float* dst, size_t count);
+
+	// The fixed point path (u8 images only). Everything is exact integer math, so
+	// the variants agree trivially.
+
+	// dst[i] = int16_t(src[i])
+	void (*mLoadU8ToI16)(const uint8_t* src, int16_t* dst, size_t count);
+
+	// accum[i] += a[i] * wa + b[i] * wb; two taps at a time, which is what pmaddwd does.
+	void (*mMulAdd2I16)(int32_t* accum, const int16_t* a, const int16_t* b, int16_t wa, int16_t wb, size_t count);
+
+	// dst[i] = uint8_t(clamp(accum[i] >> shift, 0, 255))
+	void (*mStoreI32ToU8)(const int32_t* accum, int shift, uint8_t* dst, size_t count);
+
+	// Resampling: dst[i] = sum over t < taps of weights[t * count + i] * src[offsets[i] + t * tapStride],
+	// summed in order of t. The AVX2 version gathers; the SSE2 one does four outputs at a time.
+	void (*mResample)(const float* src, const int32_t* offsets, const float* weights, size_t taps,
+					  size_t tapStride, float* dst, size_t count);
+
+	// Colour conversions: dst[i] = ((a[i] * wa + b[i] * wb) + c[i] * wc) + offset. dst may be
+	// one of a, b or c.
+	void (*mCombine3)(const float* a, const float* b, const float* c, float wa, float wb, float wc, float offset,
+					  float* dst, size_t count);
+
+	// 16 bit channels: dst[i] = float(src[i]) / 65535.0f, and the matching store,
+	// dst[i] = uint16_t(clamp(src[i] * 65535.0f, 0.0f, 65535.0f))
+	void (*mLoadU16)(const uint16_t* src, float* dst, size_t count);
+	void (*mStoreU16)(const float* src, uint16_t* dst, size_t count);
+
+	// 3x3 gradients, everything about a pixel in one go. above, row and below are rows
+	// padded by a pixel on either side, so output i reads [i, i + 2] of each. With
+	// s(j) = (above[j] + below[j]) * side + row[j] * centre and d(j) = below[j] - above[j]:
+	//   dx[i] = s(i + 2) - s(i)
+	//   dy[i] = (d(i) + d(i + 2)) * side + d(i + 1) * centre
+	//   magnitude[i] = sqrt(dx[i] * dx[i] + dy[i] * dy[i])
+	//   orientation[i] = the nearest of 8 directions, 0 along +x and counting towards +y
+	//                    (rows go down), found by comparing |dy| with |dx| * tan(22.5)
+	//                    and |dx| * tan(67.5). A zero gradient is 0.
+	void (*mGradient)(const float* above, const float* row, const float* below, float side, float centre, float* dx,
+					  float* dy, float* magnitude, uint8_t* orientation, size_t count);
+};
+
+// The best set the host supports.
+const row_kernels& kernels(void);
+
+// A specific set; falls back to scalar if the host (or the build) doesn't support it.
+const row_kernels& kernels(isa which);
+
+const char* to_string(isa which);
+
+} // namespace simd
+} // namespace img
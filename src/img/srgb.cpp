@@ -0,0 +1,130 @@
+#include "srgb.h"
+
+#include <math.h>
+#include <string.h>
+#include <limits>
+
+namespace img {
+namespace srgb {
+
+namespace {
+
+double to_linear(double v)
+{
+	return v <= 0.04045 ? v / 12.92 : pow((v + 0.055) / 1.055, 2.4);
+}
+
+double to_srgb(double v)
+{
+	return v <= 0.0031308 ? v * 12.92 : 1.055 * pow(v, 1.0 / 2.4) - 0.055;
+}
+
+float clamp01(float v)
+{
+	// NaNs end up as 0
+	return v > 0.0f ? (v < 1.0f ? v : 1.0f) : 0.0f;
+}
+
+// Encoding to 8 bits looks a value up in mBounds, starting from a guess taken from
+// its float representation: values from 2^-13 (below the midpoint between codes 0 and 1)
+// up to 1 are split into buckets of 2^-BUCKET_BITS of an octave each, and mFirst holds
+// the code at each bucket's lower end. No bucket spans more than two midpoints (the
+// widest, just below 1, is 1/256 wide, about half the distance between two codes
+// there), so two compares finish the job, exactly and without branches.
+const unsigned BUCKET_BITS = 7;
+const uint32_t LOWEST_BITS = uint32_t(127 - 13) << 23; // 2^-13
+const size_t BUCKETS = (size_t(13) << BUCKET_BITS) + 2; // one below 2^-13, and one for 1.0 itself
+
+uint32_t float_bits(float v)
+{
+	uint32_t bits;
+	memcpy(&bits, &v, sizeof(bits));
+	return bits;
+}
+
+size_t bucket(float v)
+{
+	const uint32_t bits = float_bits(v);
+	return bits < LOWEST_BITS ? 0 : size_t((bits - LOWEST_BITS) >> (23 - BUCKET_BITS)) + 1;
+}
+
+struct tables
+{
+	// Every 8 bit code, decoded
+	float mLinear[256];
+
+	// mBounds[k] is the linear value half way between codes k and k + 1 (in sRGB), so
+	// the code for v is the number of bounds at or below it. The last one is a sentinel.
+	float mBounds[256];
+
+	uint8_t mFirst[BUCKETS];
+
+	tables(void)
+	{
+		for (int k = 0; k < 256; ++k)
+			mLinear[k] = float(to_linear(k / 255.0));
+
+		for (int k = 0; k < 255; ++k)
+			mBounds[k] = float(to_linear((k + 0.5) / 255.0));
+
+		mBounds[255] = std::numeric_limits<float>::infinity();
+
+		mFirst[0] = 0;
+		for (size_t b = 1; b < BUCKETS; ++b) {
+			uint32_t bits = LOWEST_BITS + uint32_t((b - 1) << (23 - BUCKET_BITS));
+			float lowest;
+			memcpy(&lowest, &bits, sizeof(lowest));
+
+			uint8_t code = 0;
+			while (code < 255 && lowest >= mBounds[code])
+				++code;
+			mFirst[b] = code;
+		}
+	}
+};
+
+const tables& shared_tables(void)
+{
+	static const tables t;
+	return t;
+}
+
+} // namespace
+
+void decode(const uint8_t* src, float* dst, size_t count)
+{
+	const float* linear = shared_tables().mLinear;
+
+	for (size_t i = 0; i < count; ++i)
+		dst[i] = linear[src[i]];
+}
+
+void decode(const float* src, float* dst, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		dst[i] = float(to_linear(clamp01(src[i])));
+}
+
+void encode(const float* src, uint8_t* dst, size_t count)
+{
+	const tables& t = shared_tables();
+
+	for (size_t i = 0; i < count; ++i) {
+		const float v = clamp01(src[i]);
+		unsigned code = t.mFirst[bucket(v)];
+
+		code += unsigned(v >= t.mBounds[code]);
+		code += unsigned(v >= t.mBounds[code]);
+
+		dst[i] = uint8_t(code);
+	}
+}
+
+void encode(const float* src, float* dst, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		dst[i] = float(to_srgb(clamp01(src[i])));
+}
+
+} // namespace srgb
+} // namespace img
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Conversions between sRGB encoded channels and linear light, a row at a time.
+// Filtering sRGB values as they are weighs dark pixels too heavily (a 50/50 mix of
+// black and white comes out at 0.5, which displays as about 21% grey), so anything
+// which averages colours decodes first and encodes the result again.
+// Linear values are normalized floats, whatever the encoded channel type.
+
+namespace img {
+namespace srgb {
+
+// dst[i] = linear(src[i]); 8 bit channels go through a table
+void decode(const uint8_t* src, float* dst, size_t count);
+
+void decode(const float* src, float* dst, size_t count);
+
+// dst[i] = encoded(clamp(src[i], 0, 1)). 8 bit results are the nearest code, found by
+// searching the midpoints between codes rather than by evaluating pow, so
+// encode(decode(x)) == x for every 8 bit x.
+void encode(const float* src, uint8_t* dst, size_t count);
+
+void encode(const float* src, float* dst, size_t count);
+
+} // namespace srgb
+} // namespace img
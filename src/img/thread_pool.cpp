@@ -0,0 +1,192 @@
+#include "thread_pool.h"
+
+#include <stdint.h>
+#include <vector>
+
+#ifndef EMSCRIPTEN
+#	include <atomic>
+#	include <condition_variable>
+#	include <mutex>
+#	include <thread>
+#endif
+
+namespace img {
+
+#ifdef EMSCRIPTEN
+
+// No threads in the browser build; everything runs on the caller.
+struct thread_pool::impl
+{
+};
+
+thread_pool::thread_pool(size_t)
+	: mImpl(new impl())
+{
+}
+
+thread_pool::~thread_pool(void)
+{
+}
+
+void thread_pool::parallel_for(size_t count, const std::function<void(size_t)>& fn)
+{
+	for (size_t i = 0; i < count; ++i)
+		fn(i);
+}
+
+size_t thread_pool::concurrency(void) const
+{
+	return 1;
+}
+
+thread_pool& thread_pool::shared(void)
+{
+	static thread_pool pool(0);
+	return pool;
+}
+
+#else
+
+namespace {
+	thread_local bool tInsideTask = false;
+}
+
+struct thread_pool::impl
+{
+	std::vector<std::thread> mWorkers;
+
+	// Only one parallel_for runs at a time; other callers queue up here.
+	std::mutex mSubmit;
+
+	std::mutex mLock;
+	std::condition_variable mWake;
+	std::condition_variable mDone;
+
+	const std::function<void(size_t)>* mTask = nullptr;
+	size_t mCount = 0;
+	std::atomic<size_t> mNext{0};
+	size_t mFinished = 0;
+	size_t mActive = 0; // workers currently inside of drain()
+	uint64_t mGeneration = 0;
+	bool mQuit = false;
+
+	// Pulls indices off of the current task until there are none left.
+	void drain(const std::function<void(size_t)>& task, size_t count)
+	{
+		size_t finished = 0;
+		for (size_t i = mNext++; i < count; i = mNext++) {
+			task(i);
+			++finished;
+		}
+
+		if (finished) {
+			std::lock_guard<std::mutex> guard(mLock);
+			mFinished += finished;
+			if (mFinished == count)
+				mDone.notify_all();
+		}
+	}
+
+	void work(void)
+	{
+		tInsideTask = true;
+		uint64_t seen = 0;
+
+		for (;;) {
+			const std::function<void(size_t)>* task;
+			size_t count;
+
+			{
+				std::unique_lock<std::mutex> lock(mLock);
+				mWake.wait(lock, [&]() { return mQuit || (mTask && mGeneration != seen); });
+
+				if (mQuit)
+					return;
+
+				seen = mGeneration;
+				task = mTask;
+				count = mCount;
+				++mActive;
+			}
+
+			drain(*task, count);
+
+			std::lock_guard<std::mutex> guard(mLock);
+			if (--mActive == 0)
+				mDone.notify_all();
+		}
+	}
+};
+
+thread_pool::thread_pool(size_t numWorkers)
+	: mImpl(new impl())
+{
+	mImpl->mWorkers.reserve(numWorkers);
+	for (size_t i = 0; i < numWorkers; ++i)
+		mImpl->mWorkers.emplace_back([this]() { mImpl->work(); });
+}
+
+thread_pool::~thread_pool(void)
+{
+	{
+		std::lock_guard<std::mutex> guard(mImpl->mLock);
+		mImpl->mQuit = true;
+	}
+
+	mImpl->mWake.notify_all();
+
+	for (std::thread& t: mImpl->mWorkers)
+		t.join();
+}
+
+void thread_pool::parallel_for(size_t count, const std::function<void(size_t)>& fn)
+{
+	if (tInsideTask || mImpl->mWorkers.empty() || count <= 1) {
+		for (size_t i = 0; i < count; ++i)
+			fn(i);
+		return;
+	}
+
+	std::lock_guard<std::mutex> submit(mImpl->mSubmit);
+
+	{
+		std::lock_guard<std::mutex> guard(mImpl->mLock);
+		mImpl->mTask = &fn;
+		mImpl->mCount = count;
+		mImpl->mNext = 0;
+		mImpl->mFinished = 0;
+		++mImpl->mGeneration;
+	}
+
+	mImpl->mWake.notify_all();
+
+	tInsideTask = true;
+	mImpl->drain(fn, count);
+	tInsideTask = false;
+
+	// Waiting on mActive too means no worker still holds on to fn (or
+	// is about to bump mNext) once we return.
+	std::unique_lock<std::mutex> lock(mImpl->mLock);
+	mImpl->mDone.wait(lock, [&]() { return mImpl->mFinished == count && mImpl->mActive == 0; });
+
+	// Workers which wake up late see no task, rather than a dangling one.
+	mImpl->mTask = nullptr;
+}
+
+size_t thread_pool::concurrency(void) const
+{
+	return mImpl->mWorkers.size() + 1;
+}
+
+thread_pool& thread_pool::shared(void)
+{
+	static thread_pool pool([]() {
+		unsigned n = std::thread::hardware_concurrency();
+		return n > 1 ? size_t(n - 1) : size_t(0);
+	}());
+	return pool;
+}
+
+#endif // EMSCRIPTEN
+
+} // namespace img
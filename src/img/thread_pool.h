@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+#include <functional>
+#include <memory>
+
+// A fixed set of worker threads shared by the img operations which
+// support execution::parallel. Threads are started once, the first time
+// the shared pool is used, and then reused by every call after that.
+
+namespace img {
+
+struct thread_pool
+{
+private:
+	struct impl;
+	std::unique_ptr<impl> mImpl;
+
+public:
+	// numWorkers doesn't include the calling thread, which always helps out.
+	explicit thread_pool(size_t numWorkers);
+
+	~thread_pool(void);
+
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+
+	// Runs fn(0) ... fn(count - 1) across the workers and the calling thread,
+	// and returns once all of them have finished. Calls made from inside of
+	// a task run inline, so nesting can't deadlock.
+	void parallel_for(size_t count, const std::function<void(size_t)>& fn);
+
+	// Worker threads plus the calling thread.
+	size_t concurrency(void) const;
+
+	// One worker per hardware thread, minus the caller.
+	static thread_pool& shared(void);
+};
+
+} // namespace img
@@ -0,0 +1,352 @@
+#include "tile_cache.h"
+#include "memory.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <list>
+#include <unordered_map>
+
+#ifndef EMSCRIPTEN
+#	include <mutex>
+#endif
+
+namespace img {
+namespace raw {
+
+namespace {
+
+bool seek(FILE* file, int64_t offset, int origin = SEEK_SET)
+{
+#if defined(_MSC_VER)
+	return _fseeki64(file, offset, origin) == 0;
+#else
+	return fseeko(file, off_t(offset), origin) == 0;
+#endif
+}
+
+int64_t tell(FILE* file)
+{
+#if defined(_MSC_VER)
+	return _ftelli64(file);
+#else
+	return int64_t(ftello(file));
+#endif
+}
+
+} // namespace
+
+struct tile_cache::impl
+{
+	struct tile
+	{
+		memory::aligned_vector<uint8_t> mPixels; // mHeight rows of mRowBytes, no padding
+		uint32_t mX; // of the top left pixel
+		uint32_t mY;
+		uint32_t mWidth;
+		uint32_t mHeight;
+		size_t mRowBytes;
+		bool mDirty;
+		std::list<uint64_t>::iterator mUse;
+	};
+
+	FILE* mFile = nullptr;
+	header mHeader = header();
+	bool mWritable = false;
+	bool mFailed = false;
+	uint32_t mTileSize = DEFAULT_TILE_SIZE;
+	size_t mBudget = DEFAULT_BUDGET;
+	size_t mPixelBytes = 0;
+	size_t mResident = 0;
+
+	std::unordered_map<uint64_t, tile> mTiles;
+	std::list<uint64_t> mUses; // most recently used first
+
+#ifndef EMSCRIPTEN
+	mutable std::mutex mLock;
+#endif
+
+	// Where pixel (x, y) lives in the file
+	int64_t offset(uint32_t x, uint32_t y) const
+	{
+		const uint32_t row = mHeader.mFlipped ? mHeader.mHeight - 1 - y : y;
+		return int64_t(mHeader.mDataOffset) + int64_t(row) * int64_t(mHeader.mStride) + int64_t(x) * int64_t(mPixelBytes);
+	}
+
+	void load(tile& t)
+	{
+		for (uint32_t r = 0; r < t.mHeight; ++r) {
+			uint8_t* dst = &t.mPixels[r * t.mRowBytes];
+			if (!seek(mFile, offset(t.mX, t.mY + r)) || fread(dst, 1, t.mRowBytes, mFile) != t.mRowBytes) {
+				memset(dst, 0, t.mRowBytes);
+				mFailed = true;
+			}
+		}
+	}
+
+	void store(tile& t)
+	{
+		for (uint32_t r = 0; r < t.mHeight; ++r) {
+			const uint8_t* src = &t.mPixels[r * t.mRowBytes];
+			if (!seek(mFile, offset(t.mX, t.mY + r)) || fwrite(src, 1, t.mRowBytes, mFile) != t.mRowBytes)
+				mFailed = true;
+		}
+
+		t.mDirty = false;
+	}
+
+	void evict(void)
+	{
+		auto it = mTiles.find(mUses.back());
+		if (it->second.mDirty)
+			store(it->second);
+
+		mResident -= it->second.mPixels.size();
+		mUses.pop_back();
+		mTiles.erase(it);
+	}
+
+	// Tile (tx, ty), made the most recently used. If whole is set, all of it is about to be
+	// overwritten, so a tile which isn't in memory yet doesn't need to be read.
+	tile& fetch(uint32_t tx, uint32_t ty, bool whole)
+	{
+		const uint64_t key = (uint64_t(ty) << 32) | tx;
+
+		auto it = mTiles.find(key);
+		if (it != mTiles.end()) {
+			mUses.splice(mUses.begin(), mUses, it->second.mUse);
+			return it->second;
+		}
+
+		const uint32_t x = tx * mTileSize;
+		const uint32_t y = ty * mTileSize;
+
+		tile t;
+		t.mX = x;
+		t.mY = y;
+		t.mWidth = std::min(mTileSize, mHeader.mWidth - x);
+		t.mHeight = std::min(mTileSize, mHeader.mHeight - y);
+		t.mRowBytes = size_t(t.mWidth) * mPixelBytes;
+		t.mDirty = false;
+
+		// The budget is a soft one when a single tile doesn't fit into it
+		const size_t bytes = t.mRowBytes * t.mHeight;
+		while (!mUses.empty() && mResident + bytes > mBudget)
+			evict();
+
+		t.mPixels.resize(bytes);
+		if (!whole)
+			load(t);
+
+		mUses.push_front(key);
+		t.mUse = mUses.begin();
+		mResident += bytes;
+
+		return mTiles.emplace(key, std::move(t)).first->second;
+	}
+
+	// Calls fn(tile, column within the tile, row within it, columns, row within the
+	// rectangle) for every run of a row of the rectangle which lies within one tile.
+	template <typename fn_t>
+	void for_each_run(uint32_t x, uint32_t y, uint32_t width, uint32_t height, bool writing, fn_t fn)
+	{
+		if (width == 0 || height == 0)
+			return;
+
+		for (uint32_t ty = y / mTileSize; ty <= (y + height - 1) / mTileSize; ++ty) {
+			for (uint32_t tx = x / mTileSize; tx <= (x + width - 1) / mTileSize; ++tx) {
+				const uint32_t x0 = std::max(x, tx * mTileSize);
+				const uint32_t y0 = std::max(y, ty * mTileSize);
+				const uint32_t x1 = std::min(x + width, std::min(mHeader.mWidth, (tx + 1) * mTileSize));
+				const uint32_t y1 = std::min(y + height, std::min(mHeader.mHeight, (ty + 1) * mTileSize));
+
+				const bool whole = x0 == tx * mTileSize && y0 == ty * mTileSize &&
+								   x1 == std::min(mHeader.mWidth, (tx + 1) * mTileSize) &&
+								   y1 == std::min(mHeader.mHeight, (ty + 1) * mTileSize);
+
+				tile& t = fetch(tx, ty, writing && whole);
+
+				for (uint32_t r = y0; r < y1; ++r)
+					fn(t, x0 - t.mX, r - t.mY, x1 - x0, r - y);
+			}
+		}
+	}
+
+	void reset(void)
+	{
+		mTiles.clear();
+		mUses.clear();
+		mResident = 0;
+		mFailed = false;
+		mFile = nullptr;
+	}
+};
+
+tile_cache::tile_cache(void)
+	: mImpl(new impl())
+{
+}
+
+tile_cache::~tile_cache(void)
+{
+	close();
+}
+
+bool tile_cache::create(const char* path, const header& h, uint32_t tileSize, size_t budget)
+{
+	close();
+
+	header full(h);
+	full.mMagic = MAGIC;
+	full.mVersion = VERSION;
+	full.mStride = (uint64_t(row_bytes(h)) + 63) / 64 * 64;
+	full.mFlipped = 0;
+	full.mReserved = 0;
+	full.mDataOffset = DATA_OFFSET;
+
+	const uint64_t size = full.mDataOffset + full.mStride * full.mHeight;
+	if (full.mWidth == 0 || full.mHeight == 0 || !is_valid(full, size_t(size)))
+		return false;
+
+	FILE* file = fopen(path, "w+b");
+	if (!file)
+		return false;
+
+	// Writing the last byte sizes the file; everything before it reads as zeros
+	static const uint8_t ZEROS[DATA_OFFSET - sizeof(header)] = {};
+	bool ok = fwrite(&full, sizeof(full), 1, file) == 1 && fwrite(ZEROS, sizeof(ZEROS), 1, file) == 1;
+	ok = ok && seek(file, int64_t(size) - 1) && fputc(0, file) == 0 && fflush(file) == 0;
+
+	if (!ok) {
+		fclose(file);
+		remove(path);
+		return false;
+	}
+
+	mImpl->mFile = file;
+	mImpl->mHeader = full;
+	mImpl->mWritable = true;
+	mImpl->mTileSize = tileSize ? tileSize : DEFAULT_TILE_SIZE;
+	mImpl->mBudget = budget;
+	mImpl->mPixelBytes = row_bytes(full) / full.mWidth;
+	return true;
+}
+
+bool tile_cache::open(const char* path, bool writable, uint32_t tileSize, size_t budget)
+{
+	close();
+
+	FILE* file = fopen(path, writable ? "r+b" : "rb");
+	if (!file)
+		return false;
+
+	header h;
+	bool ok = fread(&h, sizeof(h), 1, file) == 1 && seek(file, 0, SEEK_END);
+	const int64_t size = ok ? tell(file) : -1;
+
+	// Nothing to cache in an empty image
+	if (!ok || size < 0 || !is_valid(h, size_t(size)) || h.mWidth == 0 || h.mHeight == 0) {
+		fclose(file);
+		return false;
+	}
+
+	mImpl->mFile = file;
+	mImpl->mHeader = h;
+	mImpl->mWritable = writable;
+	mImpl->mTileSize = tileSize ? tileSize : DEFAULT_TILE_SIZE;
+	mImpl->mBudget = budget;
+	mImpl->mPixelBytes = row_bytes(h) / h.mWidth;
+	return true;
+}
+
+bool tile_cache::close(void)
+{
+	if (!mImpl->mFile)
+		return false;
+
+	bool ok = flush();
+	ok = fclose(mImpl->mFile) == 0 && ok;
+
+	mImpl->reset();
+	return ok;
+}
+
+bool tile_cache::is_open(void) const
+{
+	return mImpl->mFile != nullptr;
+}
+
+const header& tile_cache::info(void) const
+{
+	return mImpl->mHeader;
+}
+
+bool tile_cache::read(uint32_t x, uint32_t y, uint32_t width, uint32_t height, void* dst, ptrdiff_t stride)
+{
+	impl& c = *mImpl;
+	if (!c.mFile || x > c.mHeader.mWidth - std::min(width, c.mHeader.mWidth) || width > c.mHeader.mWidth ||
+		y > c.mHeader.mHeight - std::min(height, c.mHeader.mHeight) || height > c.mHeader.mHeight)
+		return false;
+
+#ifndef EMSCRIPTEN
+	std::lock_guard<std::mutex> lock(c.mLock);
+#endif
+
+	c.for_each_run(x, y, width, height, false, [&](impl::tile& t, uint32_t tx, uint32_t ty, uint32_t count, uint32_t row) {
+		memcpy((uint8_t*) dst + ptrdiff_t(row) * stride + ptrdiff_t(t.mX + tx - x) * ptrdiff_t(c.mPixelBytes),
+			   &t.mPixels[ty * t.mRowBytes + tx * c.mPixelBytes], count * c.mPixelBytes);
+	});
+
+	return !c.mFailed;
+}
+
+bool tile_cache::write(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const void* src, ptrdiff_t stride)
+{
+	impl& c = *mImpl;
+	if (!c.mFile || !c.mWritable || x > c.mHeader.mWidth - std::min(width, c.mHeader.mWidth) ||
+		width > c.mHeader.mWidth || y > c.mHeader.mHeight - std::min(height, c.mHeader.mHeight) ||
+		height > c.mHeader.mHeight)
+		return false;
+
+#ifndef EMSCRIPTEN
+	std::lock_guard<std::mutex> lock(c.mLock);
+#endif
+
+	c.for_each_run(x, y, width, height, true, [&](impl::tile& t, uint32_t tx, uint32_t ty, uint32_t count, uint32_t row) {
+		memcpy(&t.mPixels[ty * t.mRowBytes + tx * c.mPixelBytes],
+			   (const uint8_t*) src + ptrdiff_t(row) * stride + ptrdiff_t(t.mX + tx - x) * ptrdiff_t(c.mPixelBytes),
+			   count * c.mPixelBytes);
+		t.mDirty = true;
+	});
+
+	return !c.mFailed;
+}
+
+bool tile_cache::flush(void)
+{
+	impl& c = *mImpl;
+	if (!c.mFile)
+		return false;
+
+#ifndef EMSCRIPTEN
+	std::lock_guard<std::mutex> lock(c.mLock);
+#endif
+
+	for (auto& entry: c.mTiles)
+		if (entry.second.mDirty)
+			c.store(entry.second);
+
+	return fflush(c.mFile) == 0 && !c.mFailed;
+}
+
+size_t tile_cache::resident(void) const
+{
+#ifndef EMSCRIPTEN
+	std::lock_guard<std::mutex> lock(mImpl->mLock);
+#endif
+
+	return mImpl->mResident;
+}
+
+} // namespace raw
+} // namespace img
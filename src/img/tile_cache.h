@@ -0,0 +1,71 @@
+#pragma once
+
+#include "raw_file.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+
+// Random access to the pixels of a raw container file (see raw_file.h) which may be far
+// bigger than memory. The image is split into square tiles, and those which have been
+// used recently are kept in memory, up to a budget in bytes; the least recently used
+// go first when it runs out, and are written back to the file if they've changed.
+// Regions are read and written as copies, from any number of threads at once.
+
+namespace img {
+namespace raw {
+
+struct tile_cache
+{
+private:
+	struct impl;
+	std::unique_ptr<impl> mImpl;
+
+public:
+	static const uint32_t DEFAULT_TILE_SIZE = 256;
+
+	static const size_t DEFAULT_BUDGET = size_t(256) << 20;
+
+	tile_cache(void);
+
+	// Writes back whatever has changed; see flush.
+	~tile_cache(void);
+
+	tile_cache(const tile_cache&) = delete;
+	tile_cache& operator=(const tile_cache&) = delete;
+
+	// Makes a new file for the image h describes (its stride, flipped flag and data offset
+	// are filled in here), with every pixel zero. The file is sparse where the
+	// filesystem allows it, so nothing is written until tiles are.
+	bool create(const char* path, const header& h, uint32_t tileSize = DEFAULT_TILE_SIZE,
+				size_t budget = DEFAULT_BUDGET);
+
+	// Opens an existing file, which write can only change if it's writable.
+	bool open(const char* path, bool writable, uint32_t tileSize = DEFAULT_TILE_SIZE,
+			  size_t budget = DEFAULT_BUDGET);
+
+	// Writes back changed tiles and closes the file. Returns false if any
+	// read or write failed since it was opened.
+	bool close(void);
+
+	bool is_open(void) const;
+
+	const header& info(void) const;
+
+	// Copies the width x height rectangle at (x, y), which has to lie within the image,
+	// to or from rows which start stride bytes apart (negative strides work too).
+	// Both return false if the rectangle doesn't fit, or once anything has failed to be
+	// read from or written to the file.
+	bool read(uint32_t x, uint32_t y, uint32_t width, uint32_t height, void* dst, ptrdiff_t stride);
+
+	bool write(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const void* src, ptrdiff_t stride);
+
+	// Writes every changed tile back to the file, keeping them all in memory.
+	bool flush(void);
+
+	// Bytes of tiles currently in memory.
+	size_t resident(void) const;
+};
+
+} // namespace raw
+} // namespace img
@@ -1,5 +1,6 @@
 #include "renderer.h"
 #include "view.h"
+#include "img.h"
 #include <stdlib.h>
 
 //-------------------------------------------------------------------------------------------------
@@ -206,6 +207,12 @@ void texture::bind( int offset, const std::string& unif, const shader_program& p
 
 void texture::load_cube_map( void )
 {
+    if ( mPixels.empty() )
+    {
+        MLOG_ERROR( "No pixels to upload: load_cube_map() needs mPixels, which discard_pixels() frees" );
+        return;
+    }
+
     mTarget = GL_TEXTURE_CUBE_MAP;
 	
     gen_handle();
@@ -221,6 +228,17 @@ void texture::load_cube_map( void )
 }
 
 void texture::load_2d( void )
+{
+    if ( mPixels.empty() )
+    {
+        MLOG_ERROR( "No pixels to upload: load_2d() needs mPixels, which discard_pixels() frees" );
+        return;
+    }
+
+    load_2d( &mPixels[ 0 ], ptrdiff_t( mWidth ) * ptrdiff_t( mBpp ) );
+}
+
+void texture::load_2d( const uint8_t* pixels, ptrdiff_t rowBytes )
 {
     mTarget = GL_TEXTURE_2D;
     gen_handle();
@@ -228,15 +246,12 @@ void texture::load_2d( void )
 
     if ( mMipmap )
 	{
-        mMaxMip = make_mipmaps_2d< texture >( *this, mWidth, mHeight, 0 );
+        mMaxMip = load_mips_2d( pixels, rowBytes );
         mMinFilter = GL_LINEAR_MIPMAP_LINEAR;
-        GL_CHECK( glGenerateMipmap( mTarget ) );
 	}
 	else
 	{
-        GL_CHECK( glTexImage2D( mTarget,
-			0, mInternalFormat, mWidth, mHeight, 0,
-			mFormat, mBufferType, &mPixels[ 0 ] ) );
+        calc_mip_2d( 0, mWidth, mHeight, pixels, rowBytes );
 	}
 
     release();
@@ -244,6 +259,147 @@ void texture::load_2d( void )
     load_settings();
 }
 
+void texture::discard_pixels( void )
+{
+    std::vector< uint8_t >().swap( mPixels );
+}
+
+// Rows are read exactly where they are: tightly packed ones in one go, padded ones
+// through GL_UNPACK_ROW_LENGTH, and (since GL has no notion of a negative row length)
+// bottom up ones, or padded ones on ES 2, one row at a time into storage allocated up front.
+void texture::calc_mip_2d( int32_t mip, int32_t mipwidth, int32_t mipheight, const uint8_t* pixels, ptrdiff_t rowBytes ) const
+{
+    const ptrdiff_t packedBytes = ptrdiff_t( mipwidth ) * ptrdiff_t( mBpp );
+
+    GLint alignment;
+    GL_CHECK( glGetIntegerv( GL_UNPACK_ALIGNMENT, &alignment ) );
+    GL_CHECK( glPixelStorei( GL_UNPACK_ALIGNMENT, 1 ) );
+
+    if ( rowBytes == packedBytes || mipheight == 1 )
+    {
+        GL_CHECK( glTexImage2D( mTarget, mip, mInternalFormat,
+                    mipwidth, mipheight, 0, mFormat, mBufferType, pixels ) );
+    }
+#ifndef OP_GL_USE_ES
+    else if ( rowBytes > 0 && rowBytes % mBpp == 0 )
+    {
+        GL_CHECK( glPixelStorei( GL_UNPACK_ROW_LENGTH, ( GLint )( rowBytes / mBpp ) ) );
+        GL_CHECK( glTexImage2D( mTarget, mip, mInternalFormat,
+                    mipwidth, mipheight, 0, mFormat, mBufferType, pixels ) );
+        GL_CHECK( glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 ) );
+    }
+#endif
+    else
+    {
+        GL_CHECK( glTexImage2D( mTarget, mip, mInternalFormat,
+                    mipwidth, mipheight, 0, mFormat, mBufferType, nullptr ) );
+
+        for ( int32_t y = 0; y < mipheight; ++y )
+        {
+            GL_CHECK( glTexSubImage2D( mTarget, mip, 0, y, mipwidth, 1, mFormat, mBufferType,
+                        pixels + ptrdiff_t( y ) * rowBytes ) );
+        }
+    }
+
+    GL_CHECK( glPixelStorei( GL_UNPACK_ALIGNMENT, alignment ) );
+}
+
+namespace {
+
+// Uploads pixels as level 0, then every level below it as built by img::mip_chain,
+// each straight from its own (padded) rows.
+template < typename channel_t, img::color_format format >
+GLuint upload_mip_chain( const texture& tex, const uint8_t* pixels, ptrdiff_t rowBytes, bool srgb )
+{
+    using view_t = img::view< const channel_t, format >;
+    using pixel_t = typename view_t::pixel_t;
+
+    const view_t base( reinterpret_cast< typename view_t::pointer_t >( pixels ),
+                       tex.width(), tex.height(), ( int32_t )( rowBytes / ( ptrdiff_t ) sizeof( pixel_t ) ) );
+
+    const auto levels = img::mip_chain( base, img::resize_filter::box,
+                                        srgb ? img::encoding::srgb : img::encoding::linear,
+                                        img::execution::parallel );
+
+    tex.calc_mip_2d( 0, tex.width(), tex.height(), pixels, rowBytes );
+
+    for ( size_t i = 0; i < levels.size(); ++i )
+    {
+        const auto level = img::make_view( levels[ i ] );
+        tex.calc_mip_2d( ( int32_t ) i + 1, level.mWidth, level.mHeight,
+                         reinterpret_cast< const uint8_t* >( level.mPixels ),
+                         ptrdiff_t( level.mStride ) * ( ptrdiff_t ) sizeof( pixel_t ) );
+    }
+
+    return ( GLuint ) levels.size() + 1;
+}
+
+// Picks the img format for the texture's pixels, which are made of channel_t;
+// returns 0 (and uploads nothing) if there isn't one.
+template < typename channel_t >
+GLuint upload_cpu_mips( const texture& tex, const uint8_t* pixels, ptrdiff_t rowBytes, bool srgb )
+{
+    const GLsizei size = ( GLsizei ) sizeof( channel_t );
+
+    if ( tex.format() == GL_RGB && tex.bpp() == 3 * size )
+    {
+        return upload_mip_chain< channel_t, img::color_format::rgb >( tex, pixels, rowBytes, srgb );
+    }
+
+    if ( tex.format() == GL_RGBA && tex.bpp() == 4 * size )
+    {
+        return upload_mip_chain< channel_t, img::color_format::rgba >( tex, pixels, rowBytes, srgb );
+    }
+
+    if ( tex.format() == FORMAT_GREYSCALE && tex.bpp() == size )
+    {
+        return upload_mip_chain< channel_t, img::color_format::greyscale >( tex, pixels, rowBytes, srgb );
+    }
+
+    return 0;
+}
+
+} // namespace
+
+// Mips are built on the CPU for every pixel layout img has an image type for (8 bit,
+// 16 bit, half and float RGB, RGBA and greyscale); anything else is left to the driver.
+// mSrgb makes the CPU path filter in linear light.
+GLuint texture::load_mips_2d( const uint8_t* pixels, ptrdiff_t rowBytes ) const
+{
+    GLuint levels = 0;
+
+    switch ( mBufferType )
+    {
+    case GL_UNSIGNED_BYTE:
+        levels = upload_cpu_mips< uint8_t >( *this, pixels, rowBytes, mSrgb );
+        break;
+
+    case GL_UNSIGNED_SHORT:
+        levels = upload_cpu_mips< uint16_t >( *this, pixels, rowBytes, mSrgb );
+        break;
+
+#ifdef GL_HALF_FLOAT
+    case GL_HALF_FLOAT:
+        levels = upload_cpu_mips< img::half >( *this, pixels, rowBytes, mSrgb );
+        break;
+#endif
+
+    case GL_FLOAT:
+        levels = upload_cpu_mips< float >( *this, pixels, rowBytes, mSrgb );
+        break;
+    }
+
+    if ( levels )
+    {
+        return levels;
+    }
+
+    calc_mip_2d( 0, mWidth, mHeight, pixels, rowBytes );
+    GL_CHECK( glGenerateMipmap( mTarget ) );
+
+    return get_max_mip_level_2d( glm::max( mWidth, mHeight ), glm::max( mWidth, mHeight ) ) + 1;
+}
+
 void texture::load_settings( void )
 {
     bind();
@@ -282,25 +438,78 @@ bool texture::set_buffer_size( int32_t width0, int32_t height0, int32_t bpp0, ui
     return determine_formats();
 }
 
+namespace {
+
+// The size of one channel of a texture's buffer type, or 0 for a type we don't upload.
+GLsizei channel_bytes( GLenum type )
+{
+    switch ( type )
+    {
+    case GL_UNSIGNED_BYTE:
+        return 1;
+
+    case GL_UNSIGNED_SHORT:
+#ifdef GL_HALF_FLOAT
+    case GL_HALF_FLOAT:
+#endif
+        return 2;
+
+    case GL_FLOAT:
+        return 4;
+
+    default:
+        return 0;
+    }
+}
+
+// 16 bit and half channels get internal formats which keep all of their precision. ES 2
+// has none of those (its internal formats are the unsized ones the macros in opengl.h
+// give), and neither kind of channel is there anyway.
+GLenum sized_internal_format( GLsizei channels, GLenum type )
+{
+#ifndef OP_GL_USE_ES
+    if ( type == GL_UNSIGNED_SHORT )
+    {
+        return channels == 1 ? GL_LUMINANCE16 : ( channels == 3 ? GL_RGB16 : GL_RGBA16 );
+    }
+
+    if ( type == GL_HALF_FLOAT )
+    {
+        return channels == 1 ? GL_LUMINANCE16F_ARB : ( channels == 3 ? GL_RGB16F : GL_RGBA16F );
+    }
+#endif
+
+    return channels == 1 ? INTERNAL_FORMAT_GREYSCALE : ( channels == 3 ? GL_RGB8 : GL_RGBA8 );
+}
+
+} // namespace
+
+// The channel count is mBpp over the size of a channel of mBufferType, so buffer_type has
+// to be set first for anything other than bytes. Two channels (grey and alpha) aren't
+// supported.
 bool texture::determine_formats( void )
 {
-    switch( mBpp )
+    const GLsizei size = channel_bytes( mBufferType );
+
+    if ( size == 0 || mBpp % size != 0 )
+    {
+        return false;
+    }
+
+    const GLsizei channels = mBpp / size;
+
+    switch ( channels )
 	{
-	case 1: // bytes
+	case 1:
 		mFormat = FORMAT_GREYSCALE;
-		mInternalFormat = INTERNAL_FORMAT_GREYSCALE;
 		break;
 
-	case 12: // floats
-	case 3: // bytes
+	case 3:
         mFormat = GL_RGB;
-        mInternalFormat = GL_RGB8;
 		break;
 
-	case 16: // floats
-	case 4: // bytes
+	case 4:
         mFormat = GL_RGBA;
-        mInternalFormat = GL_RGBA8;
 		break;
 
 	default:
@@ -308,6 +517,8 @@ bool texture::determine_formats( void )
 		break;
 	}
 
+    mInternalFormat = sized_internal_format( channels, mBufferType );
+
 	return true;
 }
 
@@ -643,6 +854,7 @@ draw_text::draw_text( const render_pipeline& pipeline )
 	mTexture->min_filter( GL_LINEAR );
 	mTexture->mag_filter( GL_LINEAR );
 	mTexture->load_2d();
+	mTexture->discard_pixels();
 }
 
 // The atlas used is 10 x 10,
@@ -73,9 +73,6 @@ static INLINE void free_vertex_buffer( GLenum target, GLuint obj );
 
 static INLINE uint32_t get_max_mip_level_2d( int32_t baseWidth, int32_t baseHeight );
 
-template< typename texture_helper_t >
-static INLINE uint32_t make_mipmaps_2d( const texture_helper_t& tex,
-                                                int32_t baseWidth, int32_t baseHeight, int32_t maxLevels );
 //---------------------------------------------------------------------
 // POD types
 //---------------------------------------------------------------------
@@ -107,12 +104,9 @@ struct triangle
 // all texture glTexImage2D functions, because a mip level of 0 is a valid value for any texture.
 // So, consider renaming this to something like "load_pixels_2d" or something
 //
-// FIXME (1): since GL_FLOAT is allowed to be used when uploading a pixel buffer (providing we're not using ES 2 or lower),
-// using mBpp to determine both internal and external texture formats is no longer as full proof as it once was:
-// a GL_ALPHA format could easily correspond to a BPP of 4, if we're using floats as our color channel primitive, for example.
-// Or, if each channel is only a byte in size, a BPP of 4 could refer to GL_RGBA.
-// A better heuristic needs to be developed. At the very least, the user should be allowed to specify what they want explicitly without
-// side effects happening.
+// NOTE (1): determine_formats goes by mBpp and mBufferType together, since mBpp alone is
+// ambiguous once channels aren't all bytes: a BPP of 4 is RGBA bytes, or a single float.
+// So the buffer type has to be set before set_buffer_size, or formats given explicitly.
 //---------------------------------------------------------------------
 struct texture
 {
@@ -162,7 +156,19 @@ public:
 	
     void load_settings( void );
 	
+    // Uploads mPixels (from open_file or set_buffer_size), as load_cube_map does, so
+    // neither can be called once discard_pixels() has freed them.
     void load_2d( void );
+
+    // Uploads pixels which live somewhere else (e.g., an img::view) instead of mPixels,
+    // so they never get copied on the CPU side. The dimensions, bpp and formats have to
+    // be set already. rowBytes is the distance between the starts of two rows, which
+    // is negative for rows that run bottom up from pixels.
+    void load_2d( const uint8_t* pixels, ptrdiff_t rowBytes );
+
+    // Frees mPixels, e.g. once they've been uploaded and nothing else needs them. After
+    // this, only the load_2d overload which takes pixels can upload anything.
+    void discard_pixels( void );
 	
     bool open_file( const char* texPath );
 	
@@ -170,7 +176,9 @@ public:
 
     bool determine_formats( void );
 
-    void calc_mip_2d( int32_t mip, int32_t width, int32_t height ) const;
+    void calc_mip_2d( int32_t mip, int32_t width, int32_t height, const uint8_t* pixels, ptrdiff_t rowBytes ) const;
+
+    GLuint load_mips_2d( const uint8_t* pixels, ptrdiff_t rowBytes ) const;
 
 	GLuint handle( void ) const { return mHandle; }
 
@@ -190,6 +198,8 @@ public:
 
     GLuint max_mip_levels( void ) const { return mMaxMip; }
 
+    bool srgb( void ) const { return mSrgb; }
+
 	const std::vector< uint8_t >& pixels( void ) const { return mPixels; }
 
     GLsizei width( void ) const { return mWidth; }
@@ -226,6 +236,8 @@ public:
 
     void mip_map( bool mipMap );
 
+    void srgb( bool isSrgb );
+
     void pixels( std::vector< uint8_t > p );
 };
 
@@ -662,36 +674,6 @@ static INLINE uint32_t get_max_mip_level_2d( int32_t baseWidth, int32_t baseHeig
     return glm::min( ( int32_t ) glm::log2( ( float ) baseWidth ), ( int32_t ) glm::log2( ( float ) baseHeight ) );
 }
 
-template< typename texture_helper_t >
-static INLINE uint32_t make_mipmaps_2d( const texture_helper_t& tex, int32_t baseWidth, int32_t baseHeight, int32_t maxLevels )
-{
-    if ( !maxLevels )
-    {
-        maxLevels = get_max_mip_level_2d( baseWidth, baseHeight );
-    }
-
-    int32_t w = baseWidth;
-    int32_t h = baseHeight;
-    int32_t mip;
-
-    for ( mip = 0; h != 1 && w != 1; ++mip )
-    {
-        tex.calc_mip_2d( mip, w, h );
-
-        if ( h > 1 )
-        {
-            h /= 2;
-        }
-
-        if ( w > 1 )
-        {
-            w /= 2;
-        }
-    }
-
-    return mip;
-}
-
 //-------------------------------------------------------------------------------------------------------
 // POD types
 //-------------------------------------------------------------------------------------------------------
@@ -872,12 +854,6 @@ INLINE void shader_program::load_attrib_layout( const draw_buffer& buffer, const
 //-------------------------------------------------------------------------------------------------------
 
 
-INLINE void texture::calc_mip_2d( int32_t mip, int32_t mipwidth, int32_t mipheight ) const
-{
-    GL_CHECK( glTexImage2D( mTarget, mip, mInternalFormat,
-				mipwidth, mipheight, 0, mFormat, mBufferType, &mPixels[ 0 ] ) );
-}
-
 INLINE void texture::gen_handle( void )
 {
     if ( !mHandle )
@@ -964,7 +940,12 @@ INLINE void texture::max_mip_levels( GLenum maxmiplevs )
 
 INLINE void texture::mip_map( bool mipMap )
 {
-    mMaxMip = mipMap;
+    mMipmap = mipMap;
+}
+
+INLINE void texture::srgb( bool isSrgb )
+{
+    mSrgb = isSrgb;
 }
 
 INLINE void texture::pixels( std::vector< uint8_t > p )
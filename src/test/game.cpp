@@ -33,6 +33,7 @@ game::game( uint32_t width, uint32_t height )
     mBillTexture.mip_map( true );
     mBillTexture.open_file( "asset/mooninite.png" );
     mBillTexture.load_2d();
+    mBillTexture.discard_pixels();
 }
 
 void game::fill_orient_map( void )
@@ -74,7 +74,7 @@ struct image_test : public image_app_t
 			mSubTitles.push_back( "EMBOSS RGB" );
 			mViewports.push_back( glm::ivec4( 0, h, w, h ) );
 
-			image_greyscale_t gs0 = load_image< img::color_format::greyscale >( "asset/lena.png" );
+			image_greyscale_t gs0 = img::convert< image_greyscale_t >( rgb0 );
 			mTextures.push_back( make_texture( gs0 ) );
 			mOrigins.push_back( glm::vec3( 0.0f ) );
 			mSubTitles.push_back( "GREYSCALE" );
@@ -106,7 +106,12 @@ struct image_test : public image_app_t
 
 			GLenum fmt, internalFmt;
 
-			if ( format == img::color_format::rgb )
+			if ( format == img::color_format::rgba )
+			{
+				fmt = GL_RGBA;
+				internalFmt = GL_RGBA8;
+			}
+			else if ( format == img::color_format::rgb )
 			{
 				fmt = GL_RGB;
 				internalFmt = GL_RGB8;
@@ -130,11 +135,6 @@ struct image_test : public image_app_t
 			tex->min_filter( GL_LINEAR );
 			tex->mag_filter( GL_LINEAR );
 
-			// Our texture API expects its data as set of raw bytes.
-			// If we're using floats in our image, we just perform the conversion
-			// and return the buffer.
-			img::raw_buffer buf = img::get_raw_pixels( image );
-
 			// use the greatness of compile time metaprogramming to make decisions.
 			// (side note: Both D and Rust have superior metaprogramming syntax which is cleaner...however,
 			// I've never used either).
@@ -145,8 +145,12 @@ struct image_test : public image_app_t
 				type = GL_UNSIGNED_BYTE;
 
 			tex->buffer_type( type );
-			tex->pixels( buf );
-			tex->load_2d();
+
+			// The texture reads the image's rows right where they are (padding, flipped
+			// orientation and all), so nothing gets copied, and it doesn't hold on to them either.
+			const auto view = img::make_view( image );
+			tex->load_2d( reinterpret_cast< const uint8_t* >( view.mPixels ),
+						  ptrdiff_t( view.mStride ) * ptrdiff_t( sizeof( *view.mPixels ) ) );
 
 			return std::move( tex );
 		}
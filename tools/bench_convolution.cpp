@@ -0,0 +1,162 @@
+// Times img::apply_kernel against the 3x3 loop it replaced, on RGB images of 8 bit and
+// float channels:
+//
+//     bench_convolution [sizes...]
+//
+// Each size is the side of a square image (512, 2048 and 8192 if none are given). The
+// columns are the old loop with a 3x3 kernel, then kernel<N> for N = 3, 5 and 9, all on
+// one thread and in milliseconds per call, the best of a few runs. The kernels aren't
+// separable, so they take the NxN path rather than the separable one.
+// "make bench-convolution" builds and runs this with the host's compilers.
+
+#include "img.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace {
+
+// apply_kernel(image_t, glm::mat3) as it was before kernel<N>: every tap of every pixel
+// wraps its coordinates and converts its channel, and neighbours are read from the copy
+// which is being written to. Kept only to be timed.
+template <typename image_t>
+image_t old_apply_kernel(const image_t& src, const glm::mat3& kernel)
+{
+	image_t copy(src);
+
+	using int_t = typename image_t::int_t;
+	using pixel_t = typename image_t::pixel_t;
+	using channel_t = typename image_t::channel_t;
+
+	static const bool IS_FLOAT = std::is_same<float, channel_t>::value;
+
+	for (int_t y = 0; y < copy.mHeight; ++y) {
+		for (int_t x = 0; x < copy.mWidth; ++x) {
+			std::array<float, image_t::PIXEL_STRIDE> accum;
+			accum.fill(0.0f);
+
+			for (int32_t i = -1; i <= 1; ++i) {
+				for (int32_t j = -1; j <= 1; ++j) {
+					int_t px = (x + j) % copy.mWidth;
+					if (px < 0)
+						px = copy.mWidth + px;
+
+					int_t py = (y + i) % copy.mHeight;
+					if (py < 0)
+						py = copy.mHeight + py;
+
+					const pixel_t& pix = copy.mPixels[img::calc_pixel_offset(copy, px, py)];
+					const float weight = kernel[1 - i][1 - j];
+
+					for (size_t c = 0; c < accum.size(); ++c)
+						accum[c] += (IS_FLOAT ? float(pix.mChannels[c]) : float(pix.mChannels[c]) / 255.0f) * weight;
+				}
+			}
+
+			pixel_t& out = copy.mPixels[img::calc_pixel_offset(copy, x, y)];
+			for (size_t c = 0; c < accum.size(); ++c) {
+				const float v = glm::clamp(accum[c], 0.0f, 1.0f);
+				out.mChannels[c] = channel_t(IS_FLOAT ? v : v * 255.0f);
+			}
+		}
+	}
+
+	return copy;
+}
+
+// A kernel of rank N / 2 + 1, so that separate_kernel turns it down.
+template <size_t N>
+img::kernel<N> make_test_kernel(void)
+{
+	img::kernel<N> k;
+	for (size_t y = 0; y < N; ++y)
+		for (size_t x = 0; x < N; ++x)
+			k.mWeights[y * N + x] = float((x * 7 + y * 3) % 5) - 1.5f + (x == y ? 1.0f : 0.0f);
+	return img::normalize_kernel(k);
+}
+
+template <typename image_t>
+image_t make_test_image(int32_t size)
+{
+	using channel_t = typename image_t::channel_t;
+
+	image_t image(img::make_image<image_t>(size, size, typename image_t::pixel_t()));
+	uint32_t seed = 1;
+
+	for (int32_t y = 0; y < size; ++y) {
+		channel_t* row = img::detail::row_data(image, y);
+		for (size_t i = 0; i < size_t(size) * image_t::PIXEL_STRIDE; ++i) {
+			seed = seed * 1664525u + 1013904223u;
+			const float v = float(seed >> 24) / 255.0f;
+			row[i] = std::is_same<channel_t, float>::value ? channel_t(v) : channel_t(seed >> 24);
+		}
+	}
+
+	return image;
+}
+
+// The best of a few calls, in milliseconds; fewer of them for big images.
+template <typename fn_t>
+double time_ms(int32_t size, fn_t fn)
+{
+	const int runs = size >= 8192 ? 1 : (size >= 2048 ? 3 : 10);
+	double best = 0.0;
+
+	for (int r = 0; r < runs; ++r) {
+		const auto start = std::chrono::steady_clock::now();
+		fn();
+		const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		best = r == 0 ? ms : std::min(best, ms);
+	}
+
+	return best;
+}
+
+template <typename image_t>
+void bench(int32_t size, const char* type)
+{
+	const image_t src(make_test_image<image_t>(size));
+
+	const glm::mat3 k3(img::kernel_emboss(true));
+	const img::kernel<3> n3(img::to_kernel(k3));
+	const img::kernel<5> n5(make_test_kernel<5>());
+	const img::kernel<9> n9(make_test_kernel<9>());
+
+	const double old3 = time_ms(size, [&]() { old_apply_kernel(src, k3); });
+	const double new3 = time_ms(size, [&]() { img::apply_kernel(src, n3); });
+	const double new5 = time_ms(size, [&]() { img::apply_kernel(src, n5); });
+	const double new9 = time_ms(size, [&]() { img::apply_kernel(src, n9); });
+
+	printf("%6d  %-4s %9.1f %9.1f %9.1f %9.1f\n", size, type, old3, new3, new5, new9);
+	fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	std::vector<int32_t> sizes;
+	for (int i = 1; i < argc; ++i) {
+		const int size = atoi(argv[i]);
+		if (size < 1) {
+			fprintf(stderr, "usage: %s [sizes...]\n", argv[0]);
+			return 2;
+		}
+		sizes.push_back(int32_t(size));
+	}
+
+	if (sizes.empty())
+		sizes = { 512, 2048, 8192 };
+
+	printf("  size  type   old 3x3   new 3x3       5x5       9x9   (ms per call)\n");
+
+	for (int32_t size: sizes) {
+		bench<img::rgb_u8_t>(size, "u8");
+		bench<img::rgb_f32_t>(size, "f32");
+	}
+
+	return 0;
+}
@@ -0,0 +1,89 @@
+// Converts image files into img's raw container (see src/img/raw_file.h), so that
+// they can be loaded with img::map_file instead of being decoded every time:
+//
+//     raw_assets <output directory> <image files...>
+//
+// Each input becomes <output directory>/<name without extension>.rawimg, with as many
+// channels as the file has, 8 bits each, and flipped like img::from_file's default
+// (the orientation GL wants). "make raw-assets" runs this over asset/.
+// This lives outside of src/ so that it stays out of the application's build.
+
+#include "img.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+template <typename image_t>
+bool convert_file(const std::string& path, const std::string& out)
+{
+	img::from_file_error e;
+	image_t image(img::from_file<image_t>(path, &e));
+
+	if (e != img::from_file_error::none) {
+		fprintf(stderr, "%s: can't be loaded (%s)\n", path.c_str(), stbi_failure_reason());
+		return false;
+	}
+
+	if (!img::write_raw(image, out)) {
+		fprintf(stderr, "%s: can't be written\n", out.c_str());
+		return false;
+	}
+
+	printf("%s -> %s (%dx%d)\n", path.c_str(), out.c_str(), image.mWidth, image.mHeight);
+	return true;
+}
+
+std::string output_path(const std::string& dir, const std::string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	std::string name(slash == std::string::npos ? path : path.substr(slash + 1));
+
+	size_t dot = name.find_last_of('.');
+	if (dot != std::string::npos && dot > 0)
+		name.resize(dot);
+
+	return dir + "/" + name + ".rawimg";
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s <output directory> <image files...>\n", argv[0]);
+		return 2;
+	}
+
+	const std::string dir(argv[1]);
+	int failures = 0;
+
+	for (int i = 2; i < argc; ++i) {
+		const std::string path(argv[i]);
+		const std::string out(output_path(dir, path));
+
+		int width, height, channels;
+		if (!stbi_info(path.c_str(), &width, &height, &channels)) {
+			fprintf(stderr, "%s: not an image (%s)\n", path.c_str(), stbi_failure_reason());
+			++failures;
+			continue;
+		}
+
+		bool ok = false;
+		switch (channels) {
+			case 1: ok = convert_file<img::greyscale_u8_t>(path, out); break;
+			case 3: ok = convert_file<img::rgb_u8_t>(path, out); break;
+			case 4: ok = convert_file<img::rgba_u8_t>(path, out); break;
+			default:
+				fprintf(stderr, "%s: %d channels aren't supported\n", path.c_str(), channels);
+				break;
+		}
+
+		if (!ok)
+			++failures;
+	}
+
+	return failures ? 1 : 0;
+}